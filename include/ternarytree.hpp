@@ -30,1060 +30,5097 @@
 
 #include <stdexcept>
 #include <fstream>
-#include <deque>
+#include <istream>
+#include <ostream>
+#include <type_traits>
+#include <iterator>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <queue>
+#include <limits>
+#include <iomanip>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <string>
+#include <cstring>
+
+#if __cplusplus>=202002L
+#include <compare>
+#include <concepts>
+#endif
+
+#if defined(TERNARYTREE_SCORED) && defined(TERNARYTREE_LIGHT)
+#error "TERNARYTREE_SCORED needs the fathers of the nodes, it can not be used with TERNARYTREE_LIGHT."
+#endif
 
 /*!
-*\class TernaryTree ternarytree.hpp "ternarytree.hpp"
-*\brief A template class to create and use ternary trees.
+*\class TernaryTreeCompare ternarytree.hpp "ternarytree.hpp"
+*\brief The default three-way comparator of the TernaryTree class.
+* Compare two OP variables with a single subtraction for integral types of at most two bytes,
+* with the operator '<=>' when it is available (C++20), with the operators '<' and '>' otherwise.
 */
-template <class OP,class STORED>
-class TernaryTree
+template <class OP>
+struct TernaryTreeCompare
 {
-private:
-
 	/*!
-	*\class Node ternarytree.hpp "ternarytree.hpp"
-	*\brief A private class of TernaryTree to handle each node
+	*\brief Compare two OP variables.
+	*\param[in] a const OP& : the first OP variable.
+	*\param[in] b const OP& : the second OP variable.
+	*\return int : a negative value if a<b, 0 if a==b, a positive value if a>b.
 	*/
-	class Node
+	int operator()(const OP& a,const OP& b) const
 	{
-	public:
-		// template variables
-		OP _op;
-		STORED* _stored;
-
-		// structure variables
-		Node* _greater;
-		Node* _smaller;
-		Node* _next;
-
-		// additional variables
-		#ifndef TERNARYTREE_LIGHT
-		unsigned int _nb_greater;
-		unsigned int _nb_smaller;
-		unsigned int _nb_next;
-		unsigned int* _father_nb;
-		bool _optimize_in_process;
-		Node* _father;
-		Node** _father_link;
-		#endif // TERNARYTREE_LIGHT
-
-		/*!
-		*\brief Constructor of the Node class
-		*/
-		Node() : _stored(nullptr), _greater(nullptr),_smaller(nullptr),_next(nullptr)
-		{
-			// additional variables
-			#ifndef TERNARYTREE_LIGHT
-			_nb_greater=0;
-			_nb_smaller=0;
-			_nb_next=0;
-			_father_nb=nullptr;
-			_optimize_in_process=false;
-			_father=nullptr;
-			_father_link=nullptr;
-			#endif // TERNARYTREE_LIGHT
-		}
-
-		/*!
-		*\brief Destrutor of the Node class
-		*/
-		~Node()
-		{
-			if(_stored!=nullptr)
-				delete _stored;
-			if(_next!=nullptr)
-				delete _next;
-			if(_greater!=nullptr)
-				delete _greater;
-			if(_smaller!=nullptr)
-				delete _smaller;
-		}
-	};
-
-	Node* _first=nullptr;
-	Node* _cursor=nullptr;
+		return compare(a,b,Method());
+	}
 
-	unsigned int _nb_node=0;
-	unsigned int _nb_stored=0;
+private:
 
-	#ifndef TERNARYTREE_LIGHT
-	bool find_to_add;
-	#endif // TERNARYTREE_LIGHT
+	#if defined(__cpp_lib_three_way_comparison) && defined(__cpp_lib_concepts)
+	static constexpr bool three_way=std::three_way_comparable<OP>;
+	#else
+	static constexpr bool three_way=false;
+	#endif
 
+	/*!
+	*\brief Tag type used to select the comparison method.
+	* 0 : subtraction, 1 : operator '<=>', 2 : operators '<' and '>'.
+	*/
+	typedef std::integral_constant<int,(std::is_integral<OP>::value && sizeof(OP)<=2) ? 0 : (three_way ? 1 : 2)> Method;
 
 	/*!
-	*\brief Private terminal recursive function.
-	* Works from the subtree pointed by the cursor.
-	* Test if a collection of OP is in the subtree's structure.
-	* Set the cursor to the best matching node.
-	*\param[in] ops const OP_COL& : a collection of OP.
-	*\param[in] it OP_COL::const_iterator& : a const_iterator for the collection of OP.
-	*\return bool : true if the collection of OP is in the subtree's structure, false if not.
+	*\brief Private static function.
+	* Compare two small integral OP variables with a single subtraction.
+	* Both values fit into an int, so the difference can not overflow.
 	*/
-	template<class OP_COL>
-	bool find(const OP_COL& ops,typename OP_COL::const_iterator& it)
+	static int compare(const OP& a,const OP& b,std::integral_constant<int,0>)
 	{
-		if(_cursor==nullptr)
-			return false;
-
-		if(_cursor->_op==*it)
-		{
-			if(it+1==ops.end())
-				return true;
+		return static_cast<int>(a)-static_cast<int>(b);
+	}
 
-			if(_cursor->_next==nullptr)
-				return false;
+	#if defined(__cpp_lib_three_way_comparison) && defined(__cpp_lib_concepts)
+	/*!
+	*\brief Private static function.
+	* Compare two OP variables with the operator '<=>'.
+	*/
+	static int compare(const OP& a,const OP& b,std::integral_constant<int,1>)
+	{
+		auto r=(a<=>b);
+		if(r<0)
+			return -1;
+		if(r>0)
+			return 1;
+		return 0;
+	}
+	#endif
 
-			#ifndef TERNARYTREE_LIGHT
-			if(find_to_add)
-				_cursor->_nb_next++;
-			#endif // TERNARYTREE_LIGHT
+	/*!
+	*\brief Private static function.
+	* Compare two OP variables with the operators '<' and '>'.
+	*/
+	static int compare(const OP& a,const OP& b,std::integral_constant<int,2>)
+	{
+		if(a<b)
+			return -1;
+		if(a>b)
+			return 1;
+		return 0;
+	}
+};
 
-			_cursor=_cursor->_next;
-			return find(ops,++it);
-		}
+/*!
+*\class TernaryTreeCodec ternarytree.hpp "ternarytree.hpp"
+*\brief The block codec used by the compressed files of the TernaryTree class.
+* A small LZ77 codec in the spirit of LZ4 : each sequence is a token, some literal bytes,
+* and a copy of at least 4 bytes already decoded at a distance of at most 65535 bytes.
+* Blocks which do not get smaller are stored as they are.
+*/
+class TernaryTreeCodec
+{
+public:
 
-		if(_cursor->_op<*it)
+	/*!
+	*\brief Write an unsigned integer with 7 bits per byte, the high bit telling whether another byte follows.
+	*\param[in,out] output std::string& : the string where the integer is appended.
+	*\param[in] value std::uint64_t : the integer.
+	*\return void
+	*/
+	static void writeVarint(std::string& output,std::uint64_t value)
+	{
+		while(value>=128)
 		{
-			if(_cursor->_greater==nullptr)
-				return false;
-
-			#ifndef TERNARYTREE_LIGHT
-			if(find_to_add)
-				_cursor->_nb_greater++;
-			#endif // TERNARYTREE_LIGHT
-
-			_cursor=_cursor->_greater;
-			return find(ops,it);
+			output+=static_cast<char>((value&127)|128);
+			value>>=7;
 		}
+		output+=static_cast<char>(value);
+	}
 
-		if(_cursor->_op>*it)
+	/*!
+	*\brief Read an unsigned integer written by writeVarint.
+	*\param[in] input const std::string& : the string where the integer is.
+	*\param[in,out] pos std::size_t& : the position of the integer, moved after it.
+	*\param[out] value std::uint64_t& : the integer.
+	*\return bool : false if the string ends before the integer.
+	*/
+	static bool readVarint(const std::string& input,std::size_t& pos,std::uint64_t& value)
+	{
+		value=0;
+		for(unsigned int shift=0;shift<64;shift+=7)
 		{
-			if(_cursor->_smaller==nullptr)
+			if(pos>=input.size())
 				return false;
-
-			#ifndef TERNARYTREE_LIGHT
-			if(find_to_add)
-				_cursor->_nb_smaller++;
-			#endif // TERNARYTREE_LIGHT
-
-			_cursor=_cursor->_smaller;
-			return find(ops,it);
+			unsigned char c=static_cast<unsigned char>(input[pos++]);
+			value|=static_cast<std::uint64_t>(c&127)<<shift;
+			if(c<128)
+				return true;
 		}
-
 		return false;
 	}
 
-	#ifndef TERNARYTREE_LIGHT
 	/*!
-	*\brief Private terminal recursive function.
-	* Propagate a modification of the optimization's variable to all the father nodes.
-	*\param[in] current Node* : the current node.
-	*\param[in] delta int : the modification.
-	*\return void
+	*\brief Read an unsigned integer written by writeVarint.
+	*\param[in,out] input std::istream& : the stream where the integer is.
+	*\param[out] value std::uint64_t& : the integer.
+	*\return bool : false if the stream ends before the integer.
 	*/
-	void propagateForOptimization(Node* current,int delta)
+	static bool readVarint(std::istream& input,std::uint64_t& value)
 	{
-		if(current!=nullptr && current->_father_nb!=nullptr)
+		value=0;
+		for(unsigned int shift=0;shift<64;shift+=7)
 		{
-			current->_father_nb+=delta;
-			propagateForOptimization(current->_father,delta);
+			int c=input.get();
+			if(c==std::char_traits<char>::eof())
+				return false;
+			value|=static_cast<std::uint64_t>(c&127)<<shift;
+			if(c<128)
+				return true;
 		}
+		return false;
 	}
 
 	/*!
-	*\brief Private terminal recursive function.
-	* Return the smallest leaf of a given subtree.
-	*\param[in] current Node* : the current node.
-	*\param[in] nb unsigned int : a paramater to update optimization variables. Default value is 0.
-	*\return Node* : the smallest leaf of the given tree.
+	*\brief Compute the CRC-32 (the one of zlib) of a string.
+	*\param[in] data const std::string& : the string.
+	*\param[in] crc std::uint32_t : set by default to 0. The CRC-32 of the previous strings, to compute the one of their concatenation.
+	*\return std::uint32_t : the CRC-32.
 	*/
-	Node*  getSmallestLeaf(Node* current,unsigned int nb=0)
+	static std::uint32_t crc32(const std::string& data,std::uint32_t crc=0)
 	{
-		current->_nb_smaller+=nb;
-		if(current->_smaller!=nullptr)
-			return getSmallestLeaf(current->_smaller);
-		return current;
+		static const Crc32Table table;
+		crc=~crc;
+		for(std::size_t i=0;i<data.size();i++)
+			crc=table.values[(crc^static_cast<unsigned char>(data[i]))&255]^(crc>>8);
+		return ~crc;
 	}
 
 	/*!
-	*\brief Private terminal recursive function.
-	* Return the greatest leaf of a given subtree.
-	*\param[in] current Node* : the current node.
-	*\param[in] nb unsigned int : a paramater to update optimization variables. Default value is 0.
-	*\return Node* : the greatest leaf of the given tree.
+	*\brief Compress a string.
+	*\param[in] input const std::string& : the string to compress.
+	*\param[out] output std::string& : the compressed string.
+	*\return void
 	*/
-	Node*  getGreatestLeaf(Node* current,unsigned int nb=0)
+	static void compress(const std::string& input,std::string& output)
 	{
-		current->_nb_greater+=nb;
-		if(current->_greater!=nullptr)
-			return getGreatestLeaf(current->_greater);
-		return current;
+		output.clear();
+		const unsigned char* in=reinterpret_cast<const unsigned char*>(input.data());
+		const std::size_t size=input.size();
+
+		// last position+1 of each hashed sequence of 4 bytes
+		std::vector<std::size_t> table(std::size_t(1)<<HASH_BITS,0);
+
+		std::size_t anchor=0;
+		std::size_t i=0;
+		while(i+MIN_MATCH<=size)
+		{
+			std::uint32_t sequence=read32(in+i);
+			std::uint32_t h=static_cast<std::uint32_t>(sequence*2654435761u)>>(32-HASH_BITS);
+			std::size_t candidate=table[h];
+			table[h]=i+1;
+
+			if(candidate!=0 && i-(candidate-1)<=MAX_OFFSET && read32(in+candidate-1)==sequence)
+			{
+				std::size_t ref=candidate-1;
+				std::size_t length=MIN_MATCH;
+				while(i+length<size && in[ref+length]==in[i+length])
+					length++;
+				writeSequence(output,in+anchor,i-anchor,i-ref,length);
+				i+=length;
+				anchor=i;
+			}
+			else
+				i++;
+		}
+		// the last literals, without copy
+		writeSequence(output,in+anchor,size-anchor,0,0);
 	}
 
 	/*!
-	*\brief Private recursive function.
-	* Optimize the tree's structure to reduce the mean acces time.
-	*\param[in] current Node* : the current node.
-	*\param[in] father_link Node** : a pointer to the father's link of the current node.
-	*\return void
+	*\brief Decompress a string compressed by compress.
+	*\param[in] input const std::string& : the compressed string.
+	*\param[in] raw_size std::size_t : the size of the string before compression.
+	*\param[out] output std::string& : the decompressed string.
+	*\return bool : false if the compressed string is corrupted.
 	*/
-	void optimize(Node* current)
+	static bool decompress(const std::string& input,std::size_t raw_size,std::string& output)
 	{
-		if(current!=nullptr)
+		output.clear();
+		output.reserve(raw_size);
+		std::size_t pos=0;
+		while(pos<input.size())
 		{
-			current->_optimize_in_process=true;
-			if(current->_nb_next+current->_nb_smaller+1<current->_nb_greater) // too much in greater
-			{
-				Node* new_root=current->_greater;
-				Node* new_father;
-				int self_nb=0;
+			unsigned char token=static_cast<unsigned char>(input[pos++]);
 
-				if(current->_stored!=nullptr)
-					self_nb=1;
+			std::size_t literals=token>>4;
+			if(literals==15 && !readLength(input,pos,literals))
+				return false;
+			if(literals>input.size()-pos || literals>raw_size-output.size())
+				return false;
+			output.append(input,pos,literals);
+			pos+=literals;
 
-				current->_nb_greater=0;
-				current->_greater=nullptr;
+			if(pos==input.size())
+				break;
 
-				(*current->_father_link)=new_root;
-				new_father=getSmallestLeaf(new_root,current->_nb_next+current->_nb_smaller+self_nb);
-				new_father->_smaller=current;
+			if(input.size()-pos<2)
+				return false;
+			std::size_t offset=static_cast<unsigned char>(input[pos])|(static_cast<std::size_t>(static_cast<unsigned char>(input[pos+1]))<<8);
+			pos+=2;
+			std::size_t length=token&15;
+			if(length==15 && !readLength(input,pos,length))
+				return false;
+			length+=MIN_MATCH;
+			if(offset==0 || offset>output.size() || length>raw_size-output.size())
+				return false;
+			// the copy can overlap the bytes it writes, so it is done byte by byte
+			std::size_t from=output.size()-offset;
+			for(std::size_t i=0;i<length;i++)
+				output+=output[from+i];
+		}
+		return output.size()==raw_size;
+	}
 
-				new_root->_father=current->_father;
-				new_root->_father_link=current->_father_link;
-				current->_father=new_father;
-				current->_father_link=(&new_father->_smaller);
+	/*!
+	*\brief Write a block in a stream : its size, a method byte (0 : stored as it is, 1 : compressed), the size of the data and the data.
+	*\param[in,out] output std::ostream& : the stream where the block is written.
+	*\param[in] raw const std::string& : the block.
+	*\return void
+	*/
+	static void writeBlock(std::ostream& output,const std::string& raw)
+	{
+		std::string compressed;
+		compress(raw,compressed);
+		const bool use_compressed=compressed.size()<raw.size();
+		const std::string& data=use_compressed ? compressed : raw;
 
-				if(!new_root->_optimize_in_process)
-					optimize(new_root);
-			}
-			else
-			{
-				if(current->_greater!=nullptr && !current->_greater->_optimize_in_process)
-					optimize(current->_greater);
-			}
-			if(current->_nb_next+current->_nb_greater+1<current->_nb_smaller) // too much in smaller
-			{
-				Node* new_root=current->_smaller;
-				Node* new_father;
-				int self_nb=0;
+		std::string header;
+		writeVarint(header,raw.size());
+		header+=static_cast<char>(use_compressed ? 1 : 0);
+		writeVarint(header,data.size());
+		output.write(header.data(),static_cast<std::streamsize>(header.size()));
+		output.write(data.data(),static_cast<std::streamsize>(data.size()));
+	}
 
-				if(current->_stored!=nullptr)
-					self_nb=1;
+	/*!
+	*\brief Read a block written by writeBlock.
+	* The sizes are checked before anything is allocated : the data can not be longer than the rest of the stream
+	* (when the stream can tell its size), and a compressed block can not expand more than the codec allows.
+	*\param[in,out] input std::istream& : the stream where the block is.
+	*\param[out] raw std::string& : the block.
+	*\return bool : false if the block is corrupted.
+	*/
+	static bool readBlock(std::istream& input,std::string& raw)
+	{
+		std::uint64_t raw_size=0;
+		std::uint64_t data_size=0;
+		if(!readVarint(input,raw_size))
+			return false;
+		int method=input.get();
+		if((method!=0 && method!=1) || !readVarint(input,data_size))
+			return false;
+		if(raw_size>MAX_BLOCK || data_size>MAX_BLOCK)
+			return false;
+		// a byte of compressed data gives at most 255 bytes
+		if((method==0 && raw_size!=data_size) || (method==1 && raw_size>data_size*255+MIN_MATCH+15))
+			return false;
+		std::uint64_t remaining=0;
+		if(remainingSize(input,remaining) && data_size>remaining)
+			return false;
 
-				current->_nb_smaller=0;
-				current->_smaller=nullptr;
+		// read by chunks, so a stream which can not tell its size never makes a wrong size allocated
+		std::string data;
+		while(data.size()<data_size)
+		{
+			std::uint64_t left=data_size-data.size();
+			std::size_t chunk=static_cast<std::size_t>(left<READ_CHUNK ? left : READ_CHUNK);
+			std::size_t old_size=data.size();
+			data.resize(old_size+chunk);
+			if(!input.read(&data[old_size],static_cast<std::streamsize>(chunk)))
+				return false;
+		}
+		if(method==0)
+		{
+			raw.swap(data);
+			return raw.size()==raw_size;
+		}
+		return decompress(data,static_cast<std::size_t>(raw_size),raw);
+	}
 
-				(*current->_father_link)=new_root;
-				new_father=getGreatestLeaf(new_root,current->_nb_next+current->_nb_greater+self_nb);
-				new_father->_greater=current;
+private:
 
-				new_root->_father=current->_father;
-				new_root->_father_link=current->_father_link;
-				current->_father=new_father;
-				current->_father_link=(&new_father->_greater);
+	static const unsigned int HASH_BITS=16;
+	static const std::size_t MIN_MATCH=4;
+	static const std::size_t MAX_OFFSET=65535;
+	// size over which a block is considered corrupted
+	static const std::uint64_t MAX_BLOCK=std::uint64_t(1)<<32;
+	// size of the reads of a block
+	static const std::uint64_t READ_CHUNK=std::uint64_t(1)<<20;
 
-				if(!new_root->_optimize_in_process)
-					optimize(new_root);
-			}
-			else
+	/*!
+	*\brief The table of the CRC-32, for each value of a byte.
+	*/
+	struct Crc32Table
+	{
+		std::uint32_t values[256];
+
+		Crc32Table()
+		{
+			for(std::uint32_t i=0;i<256;i++)
 			{
-				if(current->_smaller!=nullptr && !current->_smaller->_optimize_in_process)
-					optimize(current->_smaller);
+				std::uint32_t c=i;
+				for(int k=0;k<8;k++)
+					c=(c&1) ? (0xEDB88320u^(c>>1)) : (c>>1);
+				values[i]=c;
 			}
-			optimize(current->_next);
-			current->_optimize_in_process=false;
 		}
-	}
-	#endif // TERNARYTREE_LIGHT
+	};
 
 	/*!
-	*\brief Private recursiv function.
-	* Save the subtree in a file.
-	*\param[in] current Node* : the current node.
-	*\param[in,out] n unsigned int& : the id of the current node.
-	*\param[in] f unsigned int : the father's id of the current node.
-	*\param[in] l unsigned int : the type of link between the father's current node and the current node.
-	*\param[in,out] output_file std::ofstream& : the file where the tree will be saved.
-	*\param[in] OP_TO_STRING std::string(OP) : a function to cast an OP variable into an std::string.
-	*\param[in] STORED_TO_STRING std::string(STORED) : a function to cast a STORED variable into an std::string.
-	*\return void
+	*\brief Private static function.
+	* Give the number of bytes left in a stream, if the stream can tell it.
 	*/
-	void saveToFile(Node* current,unsigned int& n,unsigned int f,unsigned int l,std::ofstream& output_file,std::string OP_TO_STRING(OP),std::string STORED_TO_STRING(STORED))
+	static bool remainingSize(std::istream& input,std::uint64_t& remaining)
 	{
-	if(current!=nullptr)
+		std::istream::pos_type current=input.tellg();
+		if(current==std::istream::pos_type(-1))
 		{
-			int current_n=n;
-			n++;
-			output_file << "<#> node ";
-			output_file <<  current_n <<"\n";
-			output_file << "<#> from ";
-			output_file <<  f <<"\n";
-			output_file << "<#> link ";
-			output_file <<  l <<"\n";
-			output_file << "<#> op ";
-			output_file <<  OP_TO_STRING(current->_op) <<"\n";
-			output_file << "<#> data ";
-			if(current->_stored!=nullptr)
-				output_file <<  STORED_TO_STRING((*current->_stored));
-			output_file << "\n<#> end\n\n";
-			saveToFile(current->_smaller,n,current_n,1,output_file,OP_TO_STRING,STORED_TO_STRING);
-			saveToFile(current->_greater,n,current_n,2,output_file,OP_TO_STRING,STORED_TO_STRING);
-			saveToFile(current->_next,n,current_n,3,output_file,OP_TO_STRING,STORED_TO_STRING);
+			input.clear();
+			return false;
+		}
+		input.seekg(0,std::ios::end);
+		std::istream::pos_type end=input.tellg();
+		input.seekg(current);
+		if(end==std::istream::pos_type(-1) || !input || end<current)
+		{
+			input.clear();
+			input.seekg(current);
+			return false;
 		}
+		remaining=static_cast<std::uint64_t>(end-current);
+		return true;
 	}
 
 	/*!
-	*\brief Private function.
-	* Load a tree from a file.
-	*\param[in,out] nodes std::deque<Node*> : a deque of Node* used to create the links between nodes.
-	*\param[in,out] input_file std::ifstream& : the file where the tree is saved.
-	*\param[in] STRING_TO_OP OP(std::string) : a function to cast an std::string  into an OP variable.
-	*\param[in] STRING_TO_STORED STORED(std::string) : a function to cast an std::string  into a STORED variable.
-	*\return void
+	*\brief Private static function.
+	* Read 4 bytes.
 	*/
-	void loadFromFile(std::deque<Node*>& nodes,std::ifstream& input_file,OP STRING_TO_OP(std::string),STORED STRING_TO_STORED(std::string))
+	static std::uint32_t read32(const unsigned char* p)
 	{
-		std::string r_str;
-
-		unsigned int node_id;
-		unsigned int father_id;
-		unsigned int link_type;
-		std::string str_op;
-		std::string str_stored;
+		std::uint32_t r;
+		std::memcpy(&r,p,sizeof(r));
+		return r;
+	}
 
-		bool dont_read=false;
+	/*!
+	*\brief Private static function.
+	* Write the 255s and the remainder of a length greater or equal to 15.
+	*/
+	static void writeLength(std::string& output,std::size_t length)
+	{
+		length-=15;
+		while(length>=255)
+		{
+			output+=static_cast<char>(255);
+			length-=255;
+		}
+		output+=static_cast<char>(length);
+	}
 
-		while(input_file)
+	/*!
+	*\brief Private static function.
+	* Read the bytes of a length written by writeLength and add them to the length.
+	*/
+	static bool readLength(const std::string& input,std::size_t& pos,std::size_t& length)
+	{
+		unsigned char c;
+		do
 		{
-			if(dont_read)
-				dont_read=false;
-			else
-				input_file >> r_str;
+			if(pos>=input.size())
+				return false;
+			c=static_cast<unsigned char>(input[pos++]);
+			length+=c;
+		}while(c==255);
+		return true;
+	}
 
-			if(r_str=="<#>")
-			{
-				input_file >> r_str;
+	/*!
+	*\brief Private static function.
+	* Write a sequence : a token, the literals, and the copy if length is not 0.
+	*/
+	static void writeSequence(std::string& output,const unsigned char* literals,std::size_t nb_literals,std::size_t offset,std::size_t length)
+	{
+		unsigned char token=static_cast<unsigned char>((nb_literals<15 ? nb_literals : 15)<<4);
+		if(length!=0)
+			token|=static_cast<unsigned char>(length-MIN_MATCH<15 ? length-MIN_MATCH : 15);
+		output+=static_cast<char>(token);
+		if(nb_literals>=15)
+			writeLength(output,nb_literals);
+		output.append(reinterpret_cast<const char*>(literals),nb_literals);
 
-				if(r_str=="node")
-					input_file >> node_id;
-				else if(r_str=="from")
-					input_file >> father_id;
-				else if(r_str=="link")
-					input_file >> link_type;
-				else if(r_str=="op")
-				{
-					input_file >> r_str;
-					while(r_str!="<#>")
+		if(length!=0)
+		{
+			output+=static_cast<char>(offset&255);
+			output+=static_cast<char>(offset>>8);
+			if(length-MIN_MATCH>=15)
+				writeLength(output,length-MIN_MATCH);
+		}
+	}
+};
+
+/*!
+*\class TernaryTreeBitVector ternarytree.hpp "ternarytree.hpp"
+*\brief A bit vector answering rank queries in constant time, used by the StaticTernaryTree class.
+* Every 512 bits, the number of 1 before them is kept in 64 bits, and the number of 1 before each of their 64 bits words in 9 bits,
+* so the rank directory takes 25% of the size of the bits.
+*/
+class TernaryTreeBitVector
+{
+private:
+
+	std::vector<std::uint64_t> _words;
+	// two values per block of 8 words : the number of 1 before the block, and the 9 bits counts inside the block
+	std::vector<std::uint64_t> _ranks;
+	std::uint64_t _size;
+
+	/*!
+	*\brief Private static function.
+	* Return the number of 1 in a word.
+	*/
+	static unsigned int popcount(std::uint64_t word)
+	{
+		#if defined(__GNUC__) || defined(__clang__)
+		return static_cast<unsigned int>(__builtin_popcountll(word));
+		#else
+		word=word-((word>>1)&0x5555555555555555ULL);
+		word=(word&0x3333333333333333ULL)+((word>>2)&0x3333333333333333ULL);
+		word=(word+(word>>4))&0x0F0F0F0F0F0F0F0FULL;
+		return static_cast<unsigned int>((word*0x0101010101010101ULL)>>56);
+		#endif
+	}
+
+public:
+
+	/*!
+	*\brief Default constructor.
+	*/
+	TernaryTreeBitVector(void) : _size(0) {}
+
+	/*!
+	*\brief Add a bit at the end of the vector.
+	* The rank directory must be built again before calling rank.
+	*\param[in] bit bool : the bit.
+	*\return void
+	*/
+	void pushBack(bool bit)
+	{
+		if(_size%64==0)
+			_words.push_back(0);
+		if(bit)
+			_words.back()|=std::uint64_t(1)<<(_size%64);
+		_size++;
+	}
+
+	/*!
+	*\brief Build the rank directory.
+	*\return void
+	*/
+	void build()
+	{
+		_ranks.assign(2*(_words.size()/8+1),0);
+		std::uint64_t total=0;
+		for(std::size_t block=0;block*8<=_words.size();block++)
+		{
+			_ranks[2*block]=total;
+			std::uint64_t inside=0;
+			for(std::size_t j=0;j<8;j++)
+			{
+				if(j>0)
+					_ranks[2*block+1]|=inside<<(9*(j-1));
+				if(block*8+j<_words.size())
+					inside+=popcount(_words[block*8+j]);
+			}
+			total+=inside;
+		}
+		_words.shrink_to_fit();
+	}
+
+	/*!
+	*\brief Return a bit.
+	*\param[in] pos std::uint64_t : the position of the bit.
+	*\return bool : the bit.
+	*/
+	bool get(std::uint64_t pos) const
+	{
+		return (_words[static_cast<std::size_t>(pos/64)]>>(pos%64))&1;
+	}
+
+	/*!
+	*\brief Return the number of 1 before a position.
+	*\param[in] pos std::uint64_t : the position, at most the size of the vector.
+	*\return std::uint64_t : the number of 1 in [0,pos).
+	*/
+	std::uint64_t rank(std::uint64_t pos) const
+	{
+		std::size_t word=static_cast<std::size_t>(pos/64);
+		std::size_t block=word/8;
+		std::size_t j=word%8;
+		std::uint64_t r=_ranks[2*block];
+		if(j>0)
+			r+=(_ranks[2*block+1]>>(9*(j-1)))&511;
+		if(pos%64!=0)
+			r+=popcount(_words[word]&((std::uint64_t(1)<<(pos%64))-1));
+		return r;
+	}
+
+	/*!
+	*\brief Return the number of bits.
+	*\return std::uint64_t : the number of bits.
+	*/
+	std::uint64_t size() const
+	{
+		return _size;
+	}
+
+	/*!
+	*\brief Return the memory used by the bits and the rank directory.
+	*\return std::size_t : the number of bytes.
+	*/
+	std::size_t memoryUsage() const
+	{
+		return (_words.capacity()+_ranks.capacity())*sizeof(std::uint64_t);
+	}
+};
+
+/*!
+*\class TernaryTree ternarytree.hpp "ternarytree.hpp"
+*\brief A template class to create and use ternary trees.
+* COMPARE is a three-way comparator : COMPARE()(a,b) returns a negative int if a<b, 0 if a==b and a positive int if a>b.
+*/
+template <class OP,class STORED,class COMPARE=TernaryTreeCompare<OP> >
+class TernaryTree
+{
+public:
+
+	/*!
+	*\brief Unsigned type used to count the nodes and the STORED variables, and to number the nodes in the files.
+	* 32 bits by default to keep the nodes small, 64 bits if the keyword TERNARYTREE_LARGE is defined.
+	*/
+	#ifdef TERNARYTREE_LARGE
+	typedef std::uint64_t size_type;
+	#else
+	typedef std::uint32_t size_type;
+	#endif // TERNARYTREE_LARGE
+
+	/*!
+	*\brief The STORED variable kept by merge when both trees have one for the same key.
+	*/
+	enum MergePolicy
+	{
+		KEEP_CURRENT,
+		KEEP_OTHER
+	};
+
+private:
+
+	template <class,class,class> friend class StaticTernaryTree;
+	template <class,class,class> friend class PersistentTernaryTree;
+
+	/*!
+	*\brief Types of link between a node and its father.
+	* The values are the ones written in the files by saveToFile.
+	*/
+	enum LinkType
+	{
+		LINK_ROOT=0,
+		LINK_SMALLER=1,
+		LINK_GREATER=2,
+		LINK_NEXT=3
+	};
+
+	/*!
+	*\brief Private trait, true if IT can be used as an iterator on OP.
+	* Arrays are excluded, so the overloads taking a range never catch a call like add("key","value").
+	*/
+	template<class IT,class=void>
+	struct IsOpIterator : std::false_type {};
+
+	template<class IT>
+	struct IsOpIterator<IT,typename std::conditional<true,void,std::pair<decltype(*std::declval<IT&>()),decltype(++std::declval<IT&>())> >::type>
+		: std::integral_constant<bool,!std::is_array<IT>::value && std::is_convertible<decltype(*std::declval<IT&>()),OP>::value> {};
+
+	/*!
+	*\brief Private trait, true if OP_COL is an array of characters, like a string literal.
+	*/
+	template<class OP_COL>
+	struct IsCharArray : std::integral_constant<bool,std::is_array<OP_COL>::value &&
+		(std::is_same<typename std::remove_cv<typename std::remove_extent<OP_COL>::type>::type,char>::value
+		|| std::is_same<typename std::remove_cv<typename std::remove_extent<OP_COL>::type>::type,signed char>::value
+		|| std::is_same<typename std::remove_cv<typename std::remove_extent<OP_COL>::type>::type,unsigned char>::value
+		|| std::is_same<typename std::remove_cv<typename std::remove_extent<OP_COL>::type>::type,wchar_t>::value
+		|| std::is_same<typename std::remove_cv<typename std::remove_extent<OP_COL>::type>::type,char16_t>::value
+		|| std::is_same<typename std::remove_cv<typename std::remove_extent<OP_COL>::type>::type,char32_t>::value)> {};
+
+	/*!
+	*\brief Private static function.
+	* Return the begin iterator of a collection of OP.
+	* A string literal is rejected at compile time : its terminating '\0' would be part of the key.
+	*\param[in] ops const OP_COL& : the collection of OP.
+	*\return an iterator on the first OP of the collection.
+	*/
+	template<class OP_COL>
+	static auto opsBegin(const OP_COL& ops) -> decltype(std::begin(ops))
+	{
+		static_assert(!IsCharArray<OP_COL>::value,"TernaryTree : a char array key would include its terminating '\\0', pass an std::string or an std::string_view.");
+		return std::begin(ops);
+	}
+
+	/*!
+	*\brief Private static function.
+	* Return the end iterator of a collection of OP.
+	*\param[in] ops const OP_COL& : the collection of OP.
+	*\return the end iterator of the collection.
+	*/
+	template<class OP_COL>
+	static auto opsEnd(const OP_COL& ops) -> decltype(std::end(ops))
+	{
+		return std::end(ops);
+	}
+
+	/*!
+	*\brief Position in a file of the next subtree of a node, written at the end of the file by saveToFile.
+	*/
+	struct SubtreeIndex
+	{
+		size_type father_id;
+		size_type first_id;
+		size_type nb_node;
+		std::streamoff begin;
+		std::streamoff end;
+	};
+
+	/*!
+	*\brief Flags of a node in the structure block of a compressed file, 4 bits per node.
+	*/
+	enum CompressedFlag
+	{
+		HAS_SMALLER=1,
+		HAS_GREATER=2,
+		HAS_NEXT=4,
+		HAS_STORED=8
+	};
+
+	/*!
+	*\brief The nodes of a compressed file waiting to be written : at most NODES_PER_FRAME nodes in depth-first order.
+	*/
+	struct CompressedFrame
+	{
+		size_type nb_node;
+		std::string structure;
+		std::vector<std::string> ops;
+		std::string stored;
+	};
+
+	static const size_type NODES_PER_FRAME=65536;
+
+	/*!
+	*\class Node ternarytree.hpp "ternarytree.hpp"
+	*\brief A private class of TernaryTree to handle each node
+	* The class is aligned on 8 bytes so that the 3 low bits of a Node* are always 0.
+	*/
+	class alignas(8) Node
+	{
+	public:
+		// template variables
+		STORED* _stored;
+
+		// structure variables
+		Node* _greater;
+		Node* _smaller;
+		Node* _next;
+
+		// additional variables
+		// _father_bits packs the father's address, the LinkType from the father (bits 0 and 1)
+		// and the optimization flag (bit 2)
+		// _nb_greater, _nb_smaller and _nb_next are the numbers of STORED variables in each subtree
+		#ifndef TERNARYTREE_LIGHT
+		std::uintptr_t _father_bits;
+		size_type _nb_greater;
+		size_type _nb_smaller;
+		size_type _nb_next;
+		#endif // TERNARYTREE_LIGHT
+
+		// the greatest score of the STORED variables of the node and of its three subtrees
+		#ifdef TERNARYTREE_SCORED
+		double _max_score;
+		#endif // TERNARYTREE_SCORED
+
+		// last, so that a small OP fills the padding at the end of the node
+		OP _op;
+
+		/*!
+		*\brief Constructor of the Node class
+		*/
+		Node() : _stored(nullptr), _greater(nullptr),_smaller(nullptr),_next(nullptr)
+		{
+			// additional variables
+			#ifndef TERNARYTREE_LIGHT
+			_father_bits=0;
+			_nb_greater=0;
+			_nb_smaller=0;
+			_nb_next=0;
+			#endif // TERNARYTREE_LIGHT
+
+			#ifdef TERNARYTREE_SCORED
+			_max_score=-std::numeric_limits<double>::infinity();
+			#endif // TERNARYTREE_SCORED
+		}
+
+		/*!
+		*\brief Destrutor of the Node class
+		*/
+		~Node()
+		{
+			if(_stored!=nullptr)
+				delete _stored;
+			if(_next!=nullptr)
+				delete _next;
+			if(_greater!=nullptr)
+				delete _greater;
+			if(_smaller!=nullptr)
+				delete _smaller;
+		}
+
+		#ifndef TERNARYTREE_LIGHT
+		/*!
+		*\brief Return the father of the node.
+		*\return Node* : the father, nullptr for the root.
+		*/
+		Node* father() const
+		{
+			return reinterpret_cast<Node*>(_father_bits & ~static_cast<std::uintptr_t>(7));
+		}
+
+		/*!
+		*\brief Return the type of link between the father and the node.
+		*\return unsigned int : a LinkType.
+		*/
+		unsigned int linkType() const
+		{
+			return static_cast<unsigned int>(_father_bits & 3);
+		}
+
+		/*!
+		*\brief Set the father of the node and the type of link between them.
+		*\param[in] father Node* : the father, nullptr for the root.
+		*\param[in] link_type unsigned int : a LinkType.
+		*\return void
+		*/
+		void setFather(Node* father,unsigned int link_type)
+		{
+			_father_bits=reinterpret_cast<std::uintptr_t>(father) | link_type | (_father_bits & 4);
+		}
+
+		/*!
+		*\brief Test if the node is being optimized.
+		*\return bool : true if the node is being optimized, false if not.
+		*/
+		bool optimizeInProcess() const
+		{
+			return (_father_bits & 4)!=0;
+		}
+
+		/*!
+		*\brief Set the optimization flag of the node.
+		*\param[in] in_process bool : the flag.
+		*\return void
+		*/
+		void setOptimizeInProcess(bool in_process)
+		{
+			if(in_process)
+				_father_bits|=4;
+			else
+				_father_bits&=~static_cast<std::uintptr_t>(4);
+		}
+		#endif // TERNARYTREE_LIGHT
+	};
+
+	Node* _first=nullptr;
+	Node* _cursor=nullptr;
+
+	COMPARE _compare;
+
+	size_type _nb_node=0;
+	size_type _nb_stored=0;
+
+	#ifdef TERNARYTREE_SCORED
+	double (*_score_function)(const STORED&)=nullptr;
+
+	/*!
+	*\brief A node waiting to be visited by topK : its STORED variable alone, or its whole subtree.
+	*/
+	struct ScoredCandidate
+	{
+		double score;
+		Node* node;
+		bool subtree;
+
+		bool operator<(const ScoredCandidate& other) const
+		{
+			return score<other.score;
+		}
+	};
+	#endif // TERNARYTREE_SCORED
+
+	#ifdef TERNARYTREE_PROFILE
+	/*!
+	*\brief What the sampled lookups did in one level of the tree.
+	*/
+	struct LevelProfile
+	{
+		std::uint64_t nb_visits;
+		std::uint64_t nb_smaller;
+		std::uint64_t nb_greater;
+		// the lookups which found the OP of the level, and went to the next level or ended there
+		std::uint64_t nb_next;
+		std::uint64_t nb_found;
+		std::uint64_t nb_missed;
+		// the greatest number of comparisons of one lookup in the level
+		std::uint64_t longest_walk;
+	};
+
+	// one lookup out of _profile_period is sampled, none if it is 0,
+	// atomic since the const lookups read it while setProfileSampling may write it
+	std::atomic<unsigned int> _profile_period{0};
+	mutable std::atomic<std::uint64_t> _profile_counter{0};
+	mutable std::mutex _profile_mutex;
+	mutable std::uint64_t _profile_nb_lookups=0;
+	mutable std::vector<LevelProfile> _profile;
+	#endif // TERNARYTREE_PROFILE
+
+	/*!
+	*\brief Private function.
+	* Compare two OP variables with the tree's comparator.
+	*\param[in] a const OP& : the first OP variable.
+	*\param[in] b const OP& : the second OP variable.
+	*\return int : a negative value if a<b, 0 if a==b, a positive value if a>b.
+	*/
+	int compareOp(const OP& a,const OP& b) const
+	{
+		return _compare(a,b);
+	}
+
+	/*!
+	*\brief Private function.
+	* Works from the subtree pointed by the cursor.
+	* Test if a range of OP is in the subtree's structure.
+	* Set the cursor to the best matching node.
+	* Each node is compared only once with the current OP and each OP is read only once,
+	* so single-pass iterators can be used.
+	*\param[in,out] it IT& : an iterator on the first OP of the range, it must be different from end.
+	* On failure it points to the first OP which is not in the structure.
+	*\param[in] end const IT& : the end iterator of the range.
+	*\param[out] link Node**& : on failure, the link of the cursor where the OP pointed by it should be added.
+	*\return bool : true if the range of OP is in the subtree's structure, false if not.
+	*/
+	template<class IT>
+	bool find(IT& it,const IT& end,Node**& link)
+	{
+		link=nullptr;
+
+		if(_cursor==nullptr)
+			return false;
+
+		#ifdef TERNARYTREE_PROFILE
+		if(sampleLookup())
+			return profiledFind(it,end,link);
+		#endif // TERNARYTREE_PROFILE
+
+		while(true)
+		{
+			int comparison=compareOp(_cursor->_op,*it);
+
+			if(comparison==0)
+			{
+				++it;
+				if(it==end)
+					return true;
+
+				if(_cursor->_next==nullptr)
+				{
+					link=&_cursor->_next;
+					return false;
+				}
+
+				_cursor=_cursor->_next;
+			}
+			else if(comparison<0)
+			{
+				if(_cursor->_greater==nullptr)
+				{
+					link=&_cursor->_greater;
+					return false;
+				}
+
+				_cursor=_cursor->_greater;
+			}
+			else
+			{
+				if(_cursor->_smaller==nullptr)
+				{
+					link=&_cursor->_smaller;
+					return false;
+				}
+
+				_cursor=_cursor->_smaller;
+			}
+		}
+	}
+
+	/*!
+	*\brief Private function.
+	* Search an OP variable in one level of the tree, the cursor is not used.
+	*\param[in] current Node* : the root of the level.
+	*\param[in] op const OP& : the OP variable.
+	*\return Node* : the node of the level matching op, nullptr if there is none.
+	*/
+	Node* findInLevel(Node* current,const OP& op) const
+	{
+		while(current!=nullptr)
+		{
+			int comparison=compareOp(current->_op,op);
+			if(comparison==0)
+				return current;
+			if(comparison<0)
+				current=current->_greater;
+			else
+				current=current->_smaller;
+		}
+		return nullptr;
+	}
+
+	/*!
+	*\brief Private function.
+	* Create a new node at an empty link.
+	*\param[in,out] link Node** : the empty link.
+	*\param[in] father Node* : the node owning the link, nullptr for the root.
+	*\param[in] link_type unsigned int : the LinkType of the link.
+	*\param[in] op const OP& : the OP variable of the new node.
+	*\return Node* : the new node.
+	*/
+	Node* createNode(Node** link,Node* father,unsigned int link_type,const OP& op)
+	{
+		(*link)=new Node();
+		_nb_node++;
+
+		#ifndef TERNARYTREE_LIGHT
+		(*link)->setFather(father,link_type);
+		#else
+		(void)father;
+		(void)link_type;
+		#endif // TERNARYTREE_LIGHT
+
+		(*link)->_op=op;
+		return (*link);
+	}
+
+	#ifndef TERNARYTREE_LIGHT
+	/*!
+	*\brief Private function.
+	* Return the link of the father which points to a node.
+	*\param[in] current Node* : the node.
+	*\return Node** : the father's link, &_first for the root.
+	*/
+	Node** fatherLink(Node* current)
+	{
+		switch(current->linkType())
+		{
+		case LINK_SMALLER:
+			return &current->father()->_smaller;
+		case LINK_GREATER:
+			return &current->father()->_greater;
+		case LINK_NEXT:
+			return &current->father()->_next;
+		default:
+			return &_first;
+		}
+	}
+
+	/*!
+	*\brief Private static function.
+	* Return the optimization's variable of the father which counts the subtree of a node.
+	*\param[in] current Node* : the node.
+	*\return size_type* : the father's variable, nullptr for the root.
+	*/
+	static size_type* fatherNb(Node* current)
+	{
+		switch(current->linkType())
+		{
+		case LINK_SMALLER:
+			return &current->father()->_nb_smaller;
+		case LINK_GREATER:
+			return &current->father()->_nb_greater;
+		case LINK_NEXT:
+			return &current->father()->_nb_next;
+		default:
+			return nullptr;
+		}
+	}
+
+	/*!
+	*\brief Private function.
+	* Propagate a modification of the optimization's variable to all the father nodes.
+	*\param[in] current Node* : the current node.
+	*\param[in] delta int : the modification.
+	*\return void
+	*/
+	void propagateForOptimization(Node* current,int delta)
+	{
+		while(current!=nullptr && current->linkType()!=LINK_ROOT)
+		{
+			(*fatherNb(current))+=delta;
+			current=current->father();
+		}
+	}
+
+	/*!
+	*\brief Private function.
+	* Return the smallest leaf of a given subtree.
+	*\param[in] current Node* : the current node.
+	*\param[in] nb size_type : the number of STORED variables which will be added under the smallest leaf,
+	* it is added to each node on the way. Default value is 0.
+	*\return Node* : the smallest leaf of the given tree.
+	*/
+	Node*  getSmallestLeaf(Node* current,size_type nb=0)
+	{
+		current->_nb_smaller+=nb;
+		while(current->_smaller!=nullptr)
+		{
+			current=current->_smaller;
+			current->_nb_smaller+=nb;
+		}
+		return current;
+	}
+
+	/*!
+	*\brief Private function.
+	* Return the greatest leaf of a given subtree.
+	*\param[in] current Node* : the current node.
+	*\param[in] nb size_type : the number of STORED variables which will be added under the greatest leaf,
+	* it is added to each node on the way. Default value is 0.
+	*\return Node* : the greatest leaf of the given tree.
+	*/
+	Node*  getGreatestLeaf(Node* current,size_type nb=0)
+	{
+		current->_nb_greater+=nb;
+		while(current->_greater!=nullptr)
+		{
+			current=current->_greater;
+			current->_nb_greater+=nb;
+		}
+		return current;
+	}
+
+	/*!
+	*\brief Private function.
+	* Remove a node from its level, its smaller and greater subtrees take its place.
+	* The node must not have a STORED variable nor a next node. The node is not deleted.
+	*\param[in] current Node* : the node to unlink.
+	*\return void
+	*/
+	void unlinkNode(Node* current)
+	{
+		Node* replacement=nullptr;
+		Node* new_father_of_smaller=nullptr;
+
+		if(current->_smaller!=nullptr && current->_greater==nullptr)
+		{
+			replacement=current->_smaller;
+		}
+		else if(current->_smaller==nullptr && current->_greater!=nullptr)
+		{
+			replacement=current->_greater;
+		}
+		else if(current->_smaller!=nullptr && current->_greater!=nullptr)
+		{
+			new_father_of_smaller=getSmallestLeaf(current->_greater,current->_nb_smaller);
+			new_father_of_smaller->_smaller=current->_smaller;
+
+			current->_smaller->setFather(new_father_of_smaller,LINK_SMALLER);
+			replacement=current->_greater;
+		}
+
+		(*fatherLink(current))=replacement;
+		if(replacement!=nullptr)
+			replacement->setFather(current->father(),current->linkType());
+
+		current->_greater=nullptr;
+		current->_smaller=nullptr;
+
+		#ifdef TERNARYTREE_SCORED
+		// the nodes from the new father of the smaller subtree to the replacement now contain it
+		if(new_father_of_smaller!=nullptr)
+			updateScores(new_father_of_smaller);
+		#else
+		(void)new_father_of_smaller;
+		#endif // TERNARYTREE_SCORED
+	}
+
+	/*!
+	*\brief Private static function.
+	* Return the number of STORED variables in a subtree.
+	*\param[in] current Node* : the root of the subtree.
+	*\return size_type : the number of STORED variables.
+	*/
+	static size_type countStored(Node* current)
+	{
+		if(current==nullptr)
+			return 0;
+		return (current->_stored!=nullptr ? 1 : 0)+current->_nb_smaller+current->_nb_greater+current->_nb_next;
+	}
+
+	#ifdef TERNARYTREE_SCORED
+	/*!
+	*\brief Private function.
+	* Return the score of the STORED variable of a node.
+	*\param[in] current const Node* : the node.
+	*\return double : the score, minus infinity if the node does not have a STORED variable.
+	*/
+	double ownScore(const Node* current) const
+	{
+		if(current->_stored==nullptr)
+			return -std::numeric_limits<double>::infinity();
+		if(_score_function==nullptr)
+			return 0;
+		return _score_function(*current->_stored);
+	}
+
+	/*!
+	*\brief Private function.
+	* Return the greatest score of a node and of its subtrees, from the scores of its children.
+	*\param[in] current const Node* : the node.
+	*\return double : the greatest score.
+	*/
+	double computeMaxScore(const Node* current) const
+	{
+		double r=ownScore(current);
+		const Node* children[3]={current->_smaller,current->_greater,current->_next};
+		for(unsigned int i=0;i<3;i++)
+			if(children[i]!=nullptr && children[i]->_max_score>r)
+				r=children[i]->_max_score;
+		return r;
+	}
+
+	/*!
+	*\brief Private function.
+	* Compute again the greatest score of a node and of its fathers, until one of them does not change.
+	*\param[in] current Node* : the first node to update.
+	*\return void
+	*/
+	void updateScores(Node* current)
+	{
+		while(current!=nullptr)
+		{
+			double score=computeMaxScore(current);
+			if(score==current->_max_score)
+				break;
+			current->_max_score=score;
+			current=current->father();
+		}
+	}
+	#endif // TERNARYTREE_SCORED
+
+	/*!
+	*\brief Private function.
+	* Compute again the optimization's variables of all the nodes, in one pass over the tree.
+	*\return void
+	*/
+	void recount()
+	{
+		// each node is visited twice : before its children (false) and after them (true)
+		std::vector<std::pair<Node*,bool> > stack;
+		if(_first!=nullptr)
+			stack.push_back(std::make_pair(_first,false));
+
+		while(!stack.empty())
+		{
+			Node* current=stack.back().first;
+			if(!stack.back().second)
+			{
+				stack.back().second=true;
+				if(current->_smaller!=nullptr)
+					stack.push_back(std::make_pair(current->_smaller,false));
+				if(current->_greater!=nullptr)
+					stack.push_back(std::make_pair(current->_greater,false));
+				if(current->_next!=nullptr)
+					stack.push_back(std::make_pair(current->_next,false));
+			}
+			else
+			{
+				stack.pop_back();
+				current->_nb_smaller=countStored(current->_smaller);
+				current->_nb_greater=countStored(current->_greater);
+				current->_nb_next=countStored(current->_next);
+				#ifdef TERNARYTREE_SCORED
+				current->_max_score=computeMaxScore(current);
+				#endif // TERNARYTREE_SCORED
+			}
+		}
+	}
+
+	/*!
+	*\brief Private function.
+	* Return the number of keys of the tree smaller than a range of OP.
+	*\param[in] it IT : an iterator on the first OP of the range.
+	*\param[in] end IT : the end iterator of the range.
+	*\return size_type : the number of keys smaller than the range of OP.
+	*/
+	template<class IT>
+	size_type rank(IT it,IT end) const
+	{
+		size_type r=0;
+		Node* current=_first;
+
+		while(current!=nullptr && it!=end)
+		{
+			int comparison=compareOp(current->_op,*it);
+
+			if(comparison==0)
+			{
+				r+=current->_nb_smaller;
+				++it;
+				if(it==end)
+					break;
+				if(current->_stored!=nullptr)
+					r++;
+				current=current->_next;
+			}
+			else if(comparison<0)
+			{
+				r+=countStored(current)-current->_nb_greater;
+				current=current->_greater;
+			}
+			else
+			{
+				current=current->_smaller;
+			}
+		}
+		return r;
+	}
+
+	/*!
+	*\brief Private recursive function.
+	* Call a function for the keys of a subtree in increasing order, skipping the first ones.
+	*\param[in] current Node* : the root of the subtree.
+	*\param[in,out] key std::vector<OP>& : the key of the father level of the subtree.
+	*\param[in,out] skip size_type& : the number of keys to skip.
+	*\param[in,out] count size_type& : the number of keys to report.
+	*\param[in] callback FUNC& : a function called as callback(const std::vector<OP>& key,const STORED& stored).
+	*\return void
+	*/
+	template<class FUNC>
+	void selectRange(Node* current,std::vector<OP>& key,size_type& skip,size_type& count,FUNC& callback) const
+	{
+		while(current!=nullptr && count>0)
+		{
+			if(skip>=current->_nb_smaller)
+				skip-=current->_nb_smaller;
+			else
+				selectRange(current->_smaller,key,skip,count,callback);
+
+			if(count==0)
+				return;
+
+			key.push_back(current->_op);
+			if(current->_stored!=nullptr)
+			{
+				if(skip>0)
+					skip--;
+				else
+				{
+					const std::vector<OP>& const_key=key;
+					const STORED& stored=*current->_stored;
+					callback(const_key,stored);
+					count--;
+				}
+			}
+			if(count>0)
+			{
+				if(skip>=current->_nb_next)
+					skip-=current->_nb_next;
+				else
+					selectRange(current->_next,key,skip,count,callback);
+			}
+			key.pop_back();
+
+			current=current->_greater;
+		}
+	}
+
+	/*!
+	*\brief Private recursive function.
+	* Optimize the tree's structure to reduce the mean acces time.
+	*\param[in] current Node* : the current node.
+	*\param[in] father_link Node** : a pointer to the father's link of the current node.
+	*\return void
+	*/
+	void optimize(Node* current)
+	{
+		if(current!=nullptr)
+		{
+			current->setOptimizeInProcess(true);
+			if(current->_nb_next+current->_nb_smaller+1<current->_nb_greater) // too much in greater
+			{
+				Node* new_root=current->_greater;
+				Node* new_father;
+				size_type self_nb=0;
+
+				if(current->_stored!=nullptr)
+					self_nb=1;
+
+				current->_nb_greater=0;
+				current->_greater=nullptr;
+
+				(*fatherLink(current))=new_root;
+				new_father=getSmallestLeaf(new_root,current->_nb_next+current->_nb_smaller+self_nb);
+				new_father->_smaller=current;
+
+				new_root->setFather(current->father(),current->linkType());
+				current->setFather(new_father,LINK_SMALLER);
+
+				if(!new_root->optimizeInProcess())
+					optimize(new_root);
+			}
+			else
+			{
+				if(current->_greater!=nullptr && !current->_greater->optimizeInProcess())
+					optimize(current->_greater);
+			}
+			if(current->_nb_next+current->_nb_greater+1<current->_nb_smaller) // too much in smaller
+			{
+				Node* new_root=current->_smaller;
+				Node* new_father;
+				size_type self_nb=0;
+
+				if(current->_stored!=nullptr)
+					self_nb=1;
+
+				current->_nb_smaller=0;
+				current->_smaller=nullptr;
+
+				(*fatherLink(current))=new_root;
+				new_father=getGreatestLeaf(new_root,current->_nb_next+current->_nb_greater+self_nb);
+				new_father->_greater=current;
+
+				new_root->setFather(current->father(),current->linkType());
+				current->setFather(new_father,LINK_GREATER);
+
+				if(!new_root->optimizeInProcess())
+					optimize(new_root);
+			}
+			else
+			{
+				if(current->_smaller!=nullptr && !current->_smaller->optimizeInProcess())
+					optimize(current->_smaller);
+			}
+			optimize(current->_next);
+			current->setOptimizeInProcess(false);
+		}
+	}
+	#endif // TERNARYTREE_LIGHT
+
+	/*!
+	*\brief Private function.
+	* Save one node in a stream.
+	*\param[in] current Node* : the node.
+	*\param[in] n size_type : the id of the node.
+	*\param[in] f size_type : the father's id of the node.
+	*\param[in] l unsigned int : the type of link between the father and the node.
+	*\param[in,out] output std::ostream& : the stream where the node will be saved.
+	*\param[in] OP_TO_STRING std::string(OP) : a function to cast an OP variable into an std::string.
+	*\param[in] STORED_TO_STRING std::string(STORED) : a function to cast a STORED variable into an std::string.
+	*\return void
+	*/
+	static void saveNode(Node* current,size_type n,size_type f,unsigned int l,std::ostream& output,std::string OP_TO_STRING(OP),std::string STORED_TO_STRING(STORED))
+	{
+		output << "<#> node ";
+		output <<  n <<"\n";
+		output << "<#> from ";
+		output <<  f <<"\n";
+		output << "<#> link ";
+		output <<  l <<"\n";
+		output << "<#> op ";
+		output <<  OP_TO_STRING(current->_op) <<"\n";
+		output << "<#> data ";
+		if(current->_stored!=nullptr)
+			output <<  STORED_TO_STRING((*current->_stored));
+		output << "\n<#> end\n\n";
+	}
+
+	/*!
+	*\brief Private recursiv function.
+	* Save the subtree in a stream, one node after the other.
+	*\param[in] current Node* : the current node.
+	*\param[in,out] n size_type& : the id of the current node.
+	*\param[in] f size_type : the father's id of the current node.
+	*\param[in] l unsigned int : the type of link between the father's current node and the current node.
+	*\param[in,out] output std::ostream& : the stream where the tree will be saved.
+	*\param[in] OP_TO_STRING std::string(OP) : a function to cast an OP variable into an std::string.
+	*\param[in] STORED_TO_STRING std::string(STORED) : a function to cast a STORED variable into an std::string.
+	*\return void
+	*/
+	void saveToStream(Node* current,size_type& n,size_type f,unsigned int l,std::ostream& output,std::string OP_TO_STRING(OP),std::string STORED_TO_STRING(STORED))
+	{
+	if(current!=nullptr)
+		{
+			size_type current_n=n;
+			n++;
+			saveNode(current,current_n,f,l,output,OP_TO_STRING,STORED_TO_STRING);
+			saveToStream(current->_smaller,n,current_n,LINK_SMALLER,output,OP_TO_STRING,STORED_TO_STRING);
+			saveToStream(current->_greater,n,current_n,LINK_GREATER,output,OP_TO_STRING,STORED_TO_STRING);
+			saveToStream(current->_next,n,current_n,LINK_NEXT,output,OP_TO_STRING,STORED_TO_STRING);
+		}
+	}
+
+	/*!
+	*\brief Private static function.
+	* Write a frame of a compressed file and empty it.
+	* A frame is its number of nodes followed by three blocks : the flags of the nodes, their OP and their STORED,
+	* and by the CRC-32 of the number of nodes and of the three blocks before compression, in 4 bytes.
+	*\param[in,out] frame CompressedFrame& : the frame.
+	*\param[in,out] output std::ostream& : the stream where the frame is written.
+	*\return void
+	*/
+	static void writeFrame(CompressedFrame& frame,std::ostream& output)
+	{
+		std::string block;
+		TernaryTreeCodec::writeVarint(block,frame.nb_node);
+		output.write(block.data(),static_cast<std::streamsize>(block.size()));
+		std::uint32_t crc=TernaryTreeCodec::crc32(block);
+
+		TernaryTreeCodec::writeBlock(output,frame.structure);
+		crc=TernaryTreeCodec::crc32(frame.structure,crc);
+
+		// the OP of the frame are written without their size when they all have the same size
+		bool same_size=true;
+		for(std::size_t i=1;i<frame.ops.size() && same_size;i++)
+			same_size=(frame.ops[i].size()==frame.ops[0].size());
+		block.clear();
+		if(same_size && !frame.ops.empty())
+		{
+			TernaryTreeCodec::writeVarint(block,frame.ops[0].size()+1);
+			for(std::size_t i=0;i<frame.ops.size();i++)
+				block+=frame.ops[i];
+		}
+		else
+		{
+			TernaryTreeCodec::writeVarint(block,0);
+			for(std::size_t i=0;i<frame.ops.size();i++)
+			{
+				TernaryTreeCodec::writeVarint(block,frame.ops[i].size());
+				block+=frame.ops[i];
+			}
+		}
+		TernaryTreeCodec::writeBlock(output,block);
+		crc=TernaryTreeCodec::crc32(block,crc);
+
+		TernaryTreeCodec::writeBlock(output,frame.stored);
+		crc=TernaryTreeCodec::crc32(frame.stored,crc);
+
+		char crc_bytes[4];
+		for(int i=0;i<4;i++)
+			crc_bytes[i]=static_cast<char>((crc>>(8*i))&255);
+		output.write(crc_bytes,4);
+
+		frame.nb_node=0;
+		frame.structure.clear();
+		frame.ops.clear();
+		frame.stored.clear();
+	}
+
+	/*!
+	*\brief Private recursiv function.
+	* Save the subtree in a compressed stream, in depth-first order.
+	*\param[in] current Node* : the current node.
+	*\param[in,out] frame CompressedFrame& : the frame receiving the nodes, written when it is full.
+	*\param[in,out] output std::ostream& : the stream where the tree will be saved.
+	*\param[in] OP_TO_STRING std::string(OP) : a function to cast an OP variable into an std::string.
+	*\param[in] STORED_TO_STRING std::string(STORED) : a function to cast a STORED variable into an std::string.
+	*\return void
+	*/
+	void saveToCompressedStream(Node* current,CompressedFrame& frame,std::ostream& output,std::string OP_TO_STRING(OP),std::string STORED_TO_STRING(STORED))
+	{
+		if(current!=nullptr)
+		{
+			unsigned int flags=0;
+			if(current->_smaller!=nullptr)
+				flags|=HAS_SMALLER;
+			if(current->_greater!=nullptr)
+				flags|=HAS_GREATER;
+			if(current->_next!=nullptr)
+				flags|=HAS_NEXT;
+			if(current->_stored!=nullptr)
+			{
+				flags|=HAS_STORED;
+				std::string str_stored=STORED_TO_STRING(*current->_stored);
+				TernaryTreeCodec::writeVarint(frame.stored,str_stored.size());
+				frame.stored+=str_stored;
+			}
+
+			// two nodes per byte
+			if(frame.nb_node%2==0)
+				frame.structure+=static_cast<char>(flags);
+			else
+				frame.structure[frame.structure.size()-1]=static_cast<char>(frame.structure[frame.structure.size()-1]|(flags<<4));
+			frame.ops.push_back(OP_TO_STRING(current->_op));
+			frame.nb_node++;
+			if(frame.nb_node==NODES_PER_FRAME)
+				writeFrame(frame,output);
+
+			saveToCompressedStream(current->_smaller,frame,output,OP_TO_STRING,STORED_TO_STRING);
+			saveToCompressedStream(current->_greater,frame,output,OP_TO_STRING,STORED_TO_STRING);
+			saveToCompressedStream(current->_next,frame,output,OP_TO_STRING,STORED_TO_STRING);
+		}
+	}
+
+	/*!
+	*\brief Private function.
+	* Load the nodes of a compressed stream.
+	* The nodes are in depth-first order, so each node fills the last empty link waiting in a stack.
+	*\param[in,out] input std::istream& : the stream where the tree is saved, after its header.
+	*\param[in] STRING_TO_OP OP(std::string) : a function to cast an std::string  into an OP variable.
+	*\param[in] STRING_TO_STORED STORED(std::string) : a function to cast an std::string  into a STORED variable.
+	*\return bool : false if the stream is corrupted.
+	*/
+	bool loadNodesFromCompressedStream(std::istream& input,OP STRING_TO_OP(std::string),STORED STRING_TO_STORED(std::string))
+	{
+		// the links waiting for a node, with their father and their type
+		struct EmptyLink
+		{
+			Node** link;
+			Node* father;
+			unsigned int link_type;
+		};
+		std::vector<EmptyLink> links;
+		EmptyLink root={&_first,nullptr,LINK_ROOT};
+		links.push_back(root);
+
+		std::string structure;
+		std::string ops;
+		std::string stored;
+		std::uint64_t nb_node=0;
+		while(true)
+		{
+			// the frames end with a frame of 0 nodes
+			if(!TernaryTreeCodec::readVarint(input,nb_node))
+				return false;
+			if(nb_node==0)
+				break;
+
+			if(nb_node>NODES_PER_FRAME || !TernaryTreeCodec::readBlock(input,structure) || !TernaryTreeCodec::readBlock(input,ops)
+			   || !TernaryTreeCodec::readBlock(input,stored) || structure.size()!=(nb_node+1)/2)
+				return false;
+
+			// nothing of the frame is used before its checksum is verified
+			unsigned char crc_bytes[4];
+			if(!input.read(reinterpret_cast<char*>(crc_bytes),4))
+				return false;
+			std::string nb_node_bytes;
+			TernaryTreeCodec::writeVarint(nb_node_bytes,nb_node);
+			std::uint32_t crc=TernaryTreeCodec::crc32(nb_node_bytes);
+			crc=TernaryTreeCodec::crc32(structure,crc);
+			crc=TernaryTreeCodec::crc32(ops,crc);
+			crc=TernaryTreeCodec::crc32(stored,crc);
+			if(crc!=(static_cast<std::uint32_t>(crc_bytes[0])|(static_cast<std::uint32_t>(crc_bytes[1])<<8)
+			        |(static_cast<std::uint32_t>(crc_bytes[2])<<16)|(static_cast<std::uint32_t>(crc_bytes[3])<<24)))
+				return false;
+
+			std::size_t op_pos=0;
+			std::size_t stored_pos=0;
+			// the size of every OP plus one, or 0 when each OP is preceded by its size
+			std::uint64_t same_size=0;
+			if(!TernaryTreeCodec::readVarint(ops,op_pos,same_size))
+				return false;
+
+			for(std::size_t i=0;i<nb_node;i++)
+			{
+				unsigned int flags=static_cast<unsigned char>(structure[i/2]);
+				flags=(i%2==0) ? (flags&15) : (flags>>4);
+
+				std::uint64_t op_size=same_size-1;
+				if(same_size==0 && !TernaryTreeCodec::readVarint(ops,op_pos,op_size))
+					return false;
+				if(links.empty() || op_size>ops.size()-op_pos)
+					return false;
+
+				EmptyLink empty=links.back();
+				links.pop_back();
+				Node* current=createNode(empty.link,empty.father,empty.link_type,STRING_TO_OP(ops.substr(op_pos,static_cast<std::size_t>(op_size))));
+				op_pos+=static_cast<std::size_t>(op_size);
+
+				if(flags&HAS_STORED)
+				{
+					std::uint64_t stored_size=0;
+					if(!TernaryTreeCodec::readVarint(stored,stored_pos,stored_size) || stored_size>stored.size()-stored_pos)
+						return false;
+					current->_stored=new STORED;
+					(*current->_stored)=STRING_TO_STORED(stored.substr(stored_pos,static_cast<std::size_t>(stored_size)));
+					stored_pos+=static_cast<std::size_t>(stored_size);
+					_nb_stored++;
+				}
+
+				// pushed in reverse order, the smaller subtree comes first
+				if(flags&HAS_NEXT)
+				{
+					EmptyLink next={&current->_next,current,LINK_NEXT};
+					links.push_back(next);
+				}
+				if(flags&HAS_GREATER)
+				{
+					EmptyLink greater={&current->_greater,current,LINK_GREATER};
+					links.push_back(greater);
+				}
+				if(flags&HAS_SMALLER)
+				{
+					EmptyLink smaller={&current->_smaller,current,LINK_SMALLER};
+					links.push_back(smaller);
+				}
+			}
+			if(op_pos!=ops.size() || stored_pos!=stored.size())
+				return false;
+		}
+
+		// an empty tree has no frame, and keeps its root link empty
+		return links.empty() || (_first==nullptr && links.size()==1);
+	}
+
+	/*!
+	*\brief Private recursiv function.
+	* Save a level of the tree in a file, and write in an index where the next subtree of each node of the level starts and ends in the file.
+	*\param[in] current Node* : the current node.
+	*\param[in,out] n size_type& : the id of the current node.
+	*\param[in] f size_type : the father's id of the current node.
+	*\param[in] l unsigned int : the type of link between the father's current node and the current node.
+	*\param[in,out] output std::ostream& : the stream where the tree will be saved, it must support tellp.
+	*\param[in] OP_TO_STRING std::string(OP) : a function to cast an OP variable into an std::string.
+	*\param[in] STORED_TO_STRING std::string(STORED) : a function to cast a STORED variable into an std::string.
+	*\param[in,out] index std::vector<SubtreeIndex>& : the index of the next subtrees.
+	*\return void
+	*/
+	void saveLevelWithIndex(Node* current,size_type& n,size_type f,unsigned int l,std::ostream& output,std::string OP_TO_STRING(OP),std::string STORED_TO_STRING(STORED),std::vector<SubtreeIndex>& index)
+	{
+		if(current!=nullptr)
+		{
+			size_type current_n=n;
+			n++;
+			saveNode(current,current_n,f,l,output,OP_TO_STRING,STORED_TO_STRING);
+			saveLevelWithIndex(current->_smaller,n,current_n,LINK_SMALLER,output,OP_TO_STRING,STORED_TO_STRING,index);
+			saveLevelWithIndex(current->_greater,n,current_n,LINK_GREATER,output,OP_TO_STRING,STORED_TO_STRING,index);
+			if(current->_next!=nullptr)
+			{
+				SubtreeIndex entry;
+				entry.father_id=current_n;
+				entry.first_id=n;
+				entry.begin=output.tellp();
+				saveToStream(current->_next,n,current_n,LINK_NEXT,output,OP_TO_STRING,STORED_TO_STRING);
+				entry.nb_node=n-entry.first_id;
+				entry.end=output.tellp();
+				index.push_back(entry);
+			}
+		}
+	}
+
+	/*!
+	*\brief Private function.
+	* Read the index written at the end of a file by saveToFile.
+	*\param[in,out] input std::istream& : the file, opened in binary mode.
+	*\param[out] index std::vector<SubtreeIndex>& : the index of the next subtrees, sorted by position in the file.
+	*\return bool : true if the file has a valid index, else false.
+	*/
+	static bool readIndex(std::istream& input,std::vector<SubtreeIndex>& index)
+	{
+		index.clear();
+
+		// the last line has a fixed size : "<#> indexat " followed by 20 digits
+		const std::streamoff last_line_size=33;
+		input.seekg(0,std::ios::end);
+		std::streamoff size=input.tellg();
+		if(!input || size<last_line_size)
+			return false;
+
+		std::string r_str;
+		std::uint64_t index_at=0;
+		input.seekg(size-last_line_size);
+		input >> r_str;
+		if(r_str!="<#>")
+			return false;
+		input >> r_str;
+		if(r_str!="indexat")
+			return false;
+		input >> index_at;
+		if(!input || index_at>=static_cast<std::uint64_t>(size))
+			return false;
+
+		input.seekg(static_cast<std::streamoff>(index_at));
+		std::streamoff previous_end=0;
+		size_type previous_id=0;
+		while(input >> r_str && r_str=="<#>")
+		{
+			input >> r_str;
+			if(r_str=="indexat")
+				break;
+			if(r_str!="index")
+				return false;
+
+			SubtreeIndex entry;
+			std::uint64_t begin=0;
+			std::uint64_t end=0;
+			input >> entry.father_id >> entry.first_id >> entry.nb_node >> begin >> end;
+			entry.begin=static_cast<std::streamoff>(begin);
+			entry.end=static_cast<std::streamoff>(end);
+			if(!input || entry.begin<previous_end || entry.end<entry.begin || entry.end>static_cast<std::streamoff>(index_at)
+			   || entry.father_id>=entry.first_id || entry.first_id<previous_id || entry.nb_node==0)
+				return false;
+			previous_end=entry.end;
+			previous_id=entry.first_id+entry.nb_node;
+			index.push_back(entry);
+		}
+		input.clear();
+		input.seekg(0);
+		return true;
+	}
+
+	/*!
+	*\brief Private function.
+	* Load a tree from a file with an index, the indexed subtrees being loaded by several threads.
+	* The nodes out of the indexed subtrees are loaded by the calling thread, then each subtree is linked to its father.
+	*\param[in] path const std::string& : path to the file where the tree is saved.
+	*\param[in,out] input std::istream& : the file, opened in binary mode.
+	*\param[in] index const std::vector<SubtreeIndex>& : the index of the next subtrees.
+	*\param[in] STRING_TO_OP OP(std::string) : a function to cast an std::string  into an OP variable.
+	*\param[in] STRING_TO_STORED STORED(std::string) : a function to cast an std::string  into a STORED variable.
+	*\param[in] PROGRESS void(size_type) : a function called with the number of loaded nodes, can be nullptr.
+	*\param[in] nb_threads unsigned int : the number of threads loading the subtrees.
+	*\return void
+	*/
+	void loadFromFileWithIndex(const std::string& path,std::istream& input,const std::vector<SubtreeIndex>& index,OP STRING_TO_OP(std::string),STORED STRING_TO_STORED(std::string),void PROGRESS(size_type),unsigned int nb_threads)
+	{
+		std::vector<TernaryTree<OP,STORED,COMPARE> > subtrees(index.size(),TernaryTree<OP,STORED,COMPARE>(_compare));
+		std::vector<std::exception_ptr> errors(nb_threads);
+		std::atomic<std::size_t> next_subtree(0);
+
+		std::vector<std::thread> workers;
+		for(unsigned int i=0;i<nb_threads;i++)
+		{
+			workers.push_back(std::thread([&,i]()
+			{
+				try
+				{
+					std::ifstream subtree_file(path.c_str(),std::ios::binary);
+					std::size_t current;
+					while((current=next_subtree++)<index.size())
+					{
+						// the root of the subtree is linked to a local father, and then to the real one by the calling thread
+						Node father;
+						std::vector<std::pair<size_type,Node*> > nodes_path(1,std::make_pair(index[current].father_id,&father));
+						subtree_file.clear();
+						subtree_file.seekg(index[current].begin);
+						subtrees[current].loadNodes(subtree_file,nodes_path,STRING_TO_OP,STRING_TO_STORED,nullptr,index[current].nb_node);
+						subtrees[current]._first=father._next;
+						father._next=nullptr;
+					}
+				}
+				catch(...)
+				{
+					errors[i]=std::current_exception();
+					next_subtree=index.size();
+				}
+			}));
+		}
+
+		std::exception_ptr error;
+		try
+		{
+			// the nodes before, between and after the indexed subtrees
+			std::vector<std::pair<size_type,Node*> > nodes_path;
+			std::vector<Node*> fathers(index.size(),nullptr);
+			std::streamoff begin=0;
+			size_type first_id=0;
+			for(std::size_t i=0;i<=index.size();i++)
+			{
+				input.clear();
+				input.seekg(begin);
+				if(i<index.size())
+				{
+					loadNodes(input,nodes_path,STRING_TO_OP,STRING_TO_STORED,PROGRESS,index[i].first_id-first_id);
+					while(!nodes_path.empty() && nodes_path.back().first!=index[i].father_id)
+						nodes_path.pop_back();
+					if(!nodes_path.empty())
+						fathers[i]=nodes_path.back().second;
+					begin=index[i].end;
+					first_id=index[i].first_id+index[i].nb_node;
+				}
+				else
+					loadNodes(input,nodes_path,STRING_TO_OP,STRING_TO_STORED,PROGRESS);
+			}
+
+			for(std::size_t i=0;i<workers.size();i++)
+				workers[i].join();
+			workers.clear();
+			for(std::size_t i=0;i<errors.size();i++)
+				if(errors[i])
+					std::rethrow_exception(errors[i]);
+
+			for(std::size_t i=0;i<index.size();i++)
+			{
+				if(fathers[i]!=nullptr && fathers[i]->_next==nullptr && subtrees[i]._first!=nullptr)
+				{
+					fathers[i]->_next=subtrees[i]._first;
+					#ifndef TERNARYTREE_LIGHT
+					fathers[i]->_next->setFather(fathers[i],LINK_NEXT);
+					#endif // TERNARYTREE_LIGHT
+					_nb_node+=subtrees[i]._nb_node;
+					_nb_stored+=subtrees[i]._nb_stored;
+					subtrees[i]._first=nullptr;
+					subtrees[i]._nb_node=0;
+					subtrees[i]._nb_stored=0;
+				}
+				if(PROGRESS!=nullptr)
+					PROGRESS(_nb_node);
+			}
+		}
+		catch(...)
+		{
+			error=std::current_exception();
+		}
+
+		if(!workers.empty())
+		{
+			next_subtree=index.size();
+			for(std::size_t i=0;i<workers.size();i++)
+				workers[i].join();
+		}
+		if(error)
+		{
+			clear();
+			std::rethrow_exception(error);
+		}
+	}
+
+	/*!
+	*\brief Private function.
+	* Load a tree from a stream.
+	* The nodes are saved in depth-first order, so the father of a node is always on the path from the root to the previous node :
+	* only this path is kept in memory to create the links between nodes.
+	* The optimization's variables are not computed.
+	*\param[in,out] input std::istream& : the stream where the tree is saved.
+	*\param[in,out] path std::vector<std::pair<size_type,Node*> >& : the ids and nodes from the root to the last loaded node.
+	*\param[in] STRING_TO_OP OP(std::string) : a function to cast an std::string  into an OP variable.
+	*\param[in] STRING_TO_STORED STORED(std::string) : a function to cast an std::string  into a STORED variable.
+	*\param[in] PROGRESS void(size_type) : a function called with the number of loaded nodes, can be nullptr.
+	*\param[in] nb_read size_type : the number of nodes to read, set by default to read until the end of the stream.
+	*\return void
+	*/
+	void loadNodes(std::istream& input,std::vector<std::pair<size_type,Node*> >& path,OP STRING_TO_OP(std::string),STORED STRING_TO_STORED(std::string),void PROGRESS(size_type),size_type nb_read=std::numeric_limits<size_type>::max())
+	{
+		std::string r_str;
+
+		size_type node_id=0;
+		size_type father_id=0;
+		unsigned int link_type=LINK_ROOT;
+		std::string str_op;
+		std::string str_stored;
+
+		bool dont_read=false;
+
+		while(nb_read>0 && input)
+		{
+			if(dont_read)
+				dont_read=false;
+			else
+				input >> r_str;
+
+			if(r_str=="<#>")
+			{
+				input >> r_str;
+
+				if(r_str=="node")
+					input >> node_id;
+				else if(r_str=="from")
+					input >> father_id;
+				else if(r_str=="link")
+					input >> link_type;
+				else if(r_str=="op")
+				{
+					input >> r_str;
+					while(input && r_str!="<#>")
+					{
+						if(str_op=="")
+							str_op+=r_str;
+						else
+							str_op+=" "+r_str;
+						input >> r_str;
+					}
+					dont_read=true;
+				}
+				else if(r_str=="data")
+				{
+					input >> r_str;
+					while(input && r_str!="<#>")
+					{
+						if(str_stored=="")
+							str_stored+=r_str;
+						else
+							str_stored+=" "+r_str;
+						input >> r_str;
+					}
+					dont_read=true;
+				}
+				else if(r_str=="end")
+				{
+					Node* father=nullptr;
+					Node** link=nullptr;
+
+					if(link_type==LINK_ROOT)
+					{
+						if(_first==nullptr)
+							link=&_first;
+					}
+					else
+					{
+						while(!path.empty() && path.back().first!=father_id)
+							path.pop_back();
+						if(!path.empty())
+						{
+							father=path.back().second;
+							switch(link_type)
+							{
+							case LINK_SMALLER:
+								link=&father->_smaller;
+								break;
+
+							case LINK_GREATER:
+								link=&father->_greater;
+								break;
+
+							case LINK_NEXT:
+								link=&father->_next;
+								break;
+
+							default:
+								//not supposed to go here
+								break;
+							}
+						}
+					}
+
+					if(link!=nullptr && (*link)==nullptr)
+					{
+						Node* current=createNode(link,father,link_type,STRING_TO_OP(str_op));
+						path.push_back(std::make_pair(node_id,current));
+
+						if(!str_stored.empty())
+						{
+							current->_stored=new STORED;
+							(*current->_stored)=STRING_TO_STORED(str_stored);
+							_nb_stored++;
+						}
+
+						if(PROGRESS!=nullptr && _nb_node%65536==0)
+							PROGRESS(_nb_node);
+					}
+
+					node_id=0;
+					father_id=0;
+					link_type=LINK_ROOT;
+					str_op.clear();
+					str_stored.clear();
+					nb_read--;
+				}
+			}
+		}
+	}
+
+	/*!
+	*\brief Private static recursive function.
+	* Copy a subtree.
+	*\param[in] source const Node* : the root of the subtree to copy.
+	*\return Node* : the root of the copy, nullptr if source is nullptr.
+	*/
+	static Node* copyNode(const Node* source)
+	{
+		if(source==nullptr)
+			return nullptr;
+
+		Node* copy=new Node();
+		copy->_op=source->_op;
+		if(source->_stored!=nullptr)
+			copy->_stored=new STORED(*source->_stored);
+
+		copy->_smaller=copyNode(source->_smaller);
+		copy->_greater=copyNode(source->_greater);
+		copy->_next=copyNode(source->_next);
+
+		#ifndef TERNARYTREE_LIGHT
+		copy->_nb_smaller=source->_nb_smaller;
+		copy->_nb_greater=source->_nb_greater;
+		copy->_nb_next=source->_nb_next;
+		#ifdef TERNARYTREE_SCORED
+		copy->_max_score=source->_max_score;
+		#endif // TERNARYTREE_SCORED
+		if(copy->_smaller!=nullptr)
+			copy->_smaller->setFather(copy,LINK_SMALLER);
+		if(copy->_greater!=nullptr)
+			copy->_greater->setFather(copy,LINK_GREATER);
+		if(copy->_next!=nullptr)
+			copy->_next->setFather(copy,LINK_NEXT);
+		#endif // TERNARYTREE_LIGHT
+
+		return copy;
+	}
+
+	/*!
+	*\brief Private static function.
+	* Count the nodes and the STORED variables of a subtree.
+	*\param[in] current const Node* : the root of the subtree.
+	*\param[in,out] nb_node size_type& : increased by the number of nodes.
+	*\param[in,out] nb_stored size_type& : increased by the number of STORED variables.
+	*\return void
+	*/
+	static void countNodes(const Node* current,size_type& nb_node,size_type& nb_stored)
+	{
+		std::vector<const Node*> stack;
+		if(current!=nullptr)
+			stack.push_back(current);
+		while(!stack.empty())
+		{
+			current=stack.back();
+			stack.pop_back();
+			nb_node++;
+			if(current->_stored!=nullptr)
+				nb_stored++;
+			if(current->_smaller!=nullptr)
+				stack.push_back(current->_smaller);
+			if(current->_greater!=nullptr)
+				stack.push_back(current->_greater);
+			if(current->_next!=nullptr)
+				stack.push_back(current->_next);
+		}
+	}
+
+	/*!
+	*\brief Private static function.
+	* List the nodes of a level in increasing order.
+	*\param[in] current NODE_PTR : the root of the level, a Node* or a const Node*.
+	*\param[out] level std::vector<NODE_PTR>& : the nodes of the level.
+	*\return void
+	*/
+	template<class NODE_PTR>
+	static void flattenLevel(NODE_PTR current,std::vector<NODE_PTR>& level)
+	{
+		level.clear();
+		std::vector<NODE_PTR> stack;
+		while(current!=nullptr || !stack.empty())
+		{
+			while(current!=nullptr)
+			{
+				stack.push_back(current);
+				current=current->_smaller;
+			}
+			current=stack.back();
+			stack.pop_back();
+			level.push_back(current);
+			current=current->_greater;
+		}
+	}
+
+	/*!
+	*\brief Private recursive function.
+	* Link sorted nodes into a balanced level, their next subtrees being kept.
+	* The fathers, the optimization's variables and the scores of the nodes of the level are set, not the ones of the root.
+	*\param[in] level const std::vector<Node*>& : the sorted nodes.
+	*\param[in] begin std::size_t : the first node of the level to build.
+	*\param[in] end std::size_t : the end of the nodes of the level to build.
+	*\return Node* : the root of the level, nullptr if there is no node.
+	*/
+	Node* buildLevel(const std::vector<Node*>& level,std::size_t begin,std::size_t end)
+	{
+		if(begin>=end)
+			return nullptr;
+
+		std::size_t middle=begin+(end-begin)/2;
+		Node* root=level[middle];
+		root->_smaller=buildLevel(level,begin,middle);
+		root->_greater=buildLevel(level,middle+1,end);
+
+		#ifndef TERNARYTREE_LIGHT
+		if(root->_smaller!=nullptr)
+			root->_smaller->setFather(root,LINK_SMALLER);
+		if(root->_greater!=nullptr)
+			root->_greater->setFather(root,LINK_GREATER);
+		if(root->_next!=nullptr)
+			root->_next->setFather(root,LINK_NEXT);
+		root->_nb_smaller=countStored(root->_smaller);
+		root->_nb_greater=countStored(root->_greater);
+		root->_nb_next=countStored(root->_next);
+		#endif // TERNARYTREE_LIGHT
+
+		#ifdef TERNARYTREE_SCORED
+		root->_max_score=computeMaxScore(root);
+		#endif // TERNARYTREE_SCORED
+
+		return root;
+	}
+
+	/*!
+	*\brief Private recursive function.
+	* Merge a level of another tree into a level of the tree, and their next levels when they have the same OP.
+	* The nodes of the other level are moved into the tree, the ones having the same OP as a node of the tree are deleted.
+	*\param[in] current Node* : the root of the level of the tree.
+	*\param[in] other Node* : the root of the level of the other tree.
+	*\param[in] policy MergePolicy : the STORED variable kept when both nodes have one, if RESOLVE is nullptr.
+	*\param[in] RESOLVE STORED(const STORED&,const STORED&) : a function called with both STORED variables to get the kept one, can be nullptr.
+	*\param[in,out] nb_deleted size_type& : the number of deleted nodes.
+	*\param[in,out] nb_deleted_stored size_type& : the number of deleted STORED variables, the keys being in both trees.
+	*\return Node* : the root of the merged level.
+	*/
+	Node* mergeLevel(Node* current,Node* other,MergePolicy policy,STORED RESOLVE(const STORED&,const STORED&),size_type& nb_deleted,size_type& nb_deleted_stored)
+	{
+		if(other==nullptr)
+			return current;
+		if(current==nullptr)
+			return other;
+
+		std::vector<Node*> level;
+		std::vector<Node*> other_level;
+		flattenLevel(current,level);
+		flattenLevel(other,other_level);
+
+		std::vector<Node*> merged;
+		merged.reserve(level.size()+other_level.size());
+		std::size_t i=0;
+		std::size_t j=0;
+		while(i<level.size() || j<other_level.size())
+		{
+			int comparison=0;
+			if(i==level.size())
+				comparison=1;
+			else if(j==other_level.size())
+				comparison=-1;
+			else
+				comparison=compareOp(level[i]->_op,other_level[j]->_op);
+
+			if(comparison<0)
+				merged.push_back(level[i++]);
+			else if(comparison>0)
+				merged.push_back(other_level[j++]);
+			else
+			{
+				Node* node=level[i++];
+				Node* other_node=other_level[j++];
+
+				if(other_node->_stored!=nullptr)
+				{
+					if(node->_stored==nullptr)
+					{
+						node->_stored=other_node->_stored;
+						other_node->_stored=nullptr;
+					}
+					else
+					{
+						if(RESOLVE!=nullptr)
+							(*node->_stored)=RESOLVE(*node->_stored,*other_node->_stored);
+						else if(policy==KEEP_OTHER)
+							std::swap(node->_stored,other_node->_stored);
+						nb_deleted_stored++;
+					}
+				}
+
+				node->_next=mergeLevel(node->_next,other_node->_next,policy,RESOLVE,nb_deleted,nb_deleted_stored);
+				other_node->_next=nullptr;
+				other_node->_smaller=nullptr;
+				other_node->_greater=nullptr;
+				delete other_node;
+				nb_deleted++;
+
+				merged.push_back(node);
+			}
+		}
+
+		return buildLevel(merged,0,merged.size());
+	}
+
+	/*!
+	*\brief Private recursive function.
+	* Keep in a level of the tree the keys which are (or are not) in a level of another tree.
+	* The nodes which do not lead to a STORED variable anymore are deleted.
+	*\param[in] current Node* : the root of the level of the tree.
+	*\param[in] other const Node* : the root of the level of the other tree.
+	*\param[in] keep_common bool : true to keep the keys which are in the other tree, false to keep the ones which are not.
+	*\param[in,out] nb_deleted size_type& : the number of deleted nodes.
+	*\param[in,out] nb_deleted_stored size_type& : the number of deleted STORED variables.
+	*\return Node* : the root of the filtered level, nullptr if it is empty.
+	*/
+	Node* filterLevel(Node* current,const Node* other,bool keep_common,size_type& nb_deleted,size_type& nb_deleted_stored)
+	{
+		if(current==nullptr || (other==nullptr && !keep_common))
+			return current;
+
+		std::vector<Node*> level;
+		flattenLevel(current,level);
+		std::vector<const Node*> other_level;
+		flattenLevel(other,other_level);
+
+		std::vector<Node*> kept;
+		kept.reserve(level.size());
+		std::size_t j=0;
+		for(std::size_t i=0;i<level.size();i++)
+		{
+			Node* node=level[i];
+			int comparison=-1;
+			while(j<other_level.size() && (comparison=compareOp(other_level[j]->_op,node->_op))<0)
+				j++;
+			const Node* other_node=(j<other_level.size() && comparison==0) ? other_level[j] : nullptr;
+
+			if(other_node==nullptr)
+			{
+				// the node and its next subtree are only in the tree
+				if(!keep_common)
+				{
+					kept.push_back(node);
+					continue;
+				}
+				countNodes(node->_next,nb_deleted,nb_deleted_stored);
+				if(node->_next!=nullptr)
+					delete node->_next;
+				node->_next=nullptr;
+				if(node->_stored!=nullptr)
+				{
+					delete node->_stored;
+					nb_deleted_stored++;
+				}
+				node->_stored=nullptr;
+			}
+			else
+			{
+				if(node->_stored!=nullptr && (other_node->_stored!=nullptr)!=keep_common)
+				{
+					delete node->_stored;
+					node->_stored=nullptr;
+					nb_deleted_stored++;
+				}
+				node->_next=filterLevel(node->_next,other_node->_next,keep_common,nb_deleted,nb_deleted_stored);
+			}
+
+			if(node->_stored==nullptr && node->_next==nullptr)
+			{
+				node->_smaller=nullptr;
+				node->_greater=nullptr;
+				delete node;
+				nb_deleted++;
+			}
+			else
+				kept.push_back(node);
+		}
+
+		return buildLevel(kept,0,kept.size());
+	}
+
+	/*!
+	*\brief Private function.
+	* Move all the keys of another tree into the tree.
+	*\param[in,out] other TernaryTree<OP,STORED,COMPARE>& : the other tree, empty after the merge.
+	*\param[in] policy MergePolicy : the STORED variable kept when a key is in both trees, if RESOLVE is nullptr.
+	*\param[in] RESOLVE STORED(const STORED&,const STORED&) : a function returning the kept STORED variable, can be nullptr.
+	*\return void
+	*/
+	void merge(TernaryTree<OP,STORED,COMPARE>& other,MergePolicy policy,STORED RESOLVE(const STORED&,const STORED&))
+	{
+		if(&other!=this)
+		{
+			size_type nb_deleted=0;
+			size_type nb_deleted_stored=0;
+			_first=mergeLevel(_first,other._first,policy,RESOLVE,nb_deleted,nb_deleted_stored);
+			if(_first!=nullptr)
+			{
+				#ifndef TERNARYTREE_LIGHT
+				_first->setFather(nullptr,LINK_ROOT);
+				#endif // TERNARYTREE_LIGHT
+			}
+			_nb_node=_nb_node+other._nb_node-nb_deleted;
+			_nb_stored=_nb_stored+other._nb_stored-nb_deleted_stored;
+
+			#ifdef TERNARYTREE_SCORED
+			// the moved subtrees have the scores of the other tree
+			if(other._score_function!=_score_function)
+				recount();
+			#endif // TERNARYTREE_SCORED
+
+			other._first=nullptr;
+			other.clear();
+		}
+		resetCursor();
+	}
+
+	/*!
+	*\brief Private function.
+	* Keep the keys which are (or are not) in another tree.
+	*\param[in] other const TernaryTree<OP,STORED,COMPARE>& : the other tree.
+	*\param[in] keep_common bool : true to keep the keys which are in the other tree, false to keep the ones which are not.
+	*\return void
+	*/
+	void filter(const TernaryTree<OP,STORED,COMPARE>& other,bool keep_common)
+	{
+		size_type nb_deleted=0;
+		size_type nb_deleted_stored=0;
+		_first=filterLevel(_first,other._first,keep_common,nb_deleted,nb_deleted_stored);
+		if(_first!=nullptr)
+		{
+			#ifndef TERNARYTREE_LIGHT
+			_first->setFather(nullptr,LINK_ROOT);
+			#endif // TERNARYTREE_LIGHT
+		}
+		_nb_node-=nb_deleted;
+		_nb_stored-=nb_deleted_stored;
+	}
+
+	/*!
+	*\brief Private recursive function.
+	* Check the invariants of a subtree, see checkIntegrity.
+	*\param[in] current const Node* : the root of the subtree.
+	*\param[in] father const Node* : the expected father of the root.
+	*\param[in] link_type unsigned int : the expected LinkType between the father and the root.
+	*\param[in] lower const OP* : every OP of the level must be greater than it, nullptr if there is no bound.
+	*\param[in] upper const OP* : every OP of the level must be smaller than it, nullptr if there is no bound.
+	*\param[in,out] nb_node size_type& : the number of nodes, increased by the ones of the subtree.
+	*\param[in,out] nb_stored size_type& : the number of STORED variables, increased by the ones of the subtree.
+	*\param[in,out] cursor_found bool& : set to true if the cursor is in the subtree.
+	*\return bool : true if the invariants hold, else false.
+	*/
+	bool checkSubtree(const Node* current,const Node* father,unsigned int link_type,const OP* lower,const OP* upper,size_type& nb_node,size_type& nb_stored,bool& cursor_found) const
+	{
+		if(current==nullptr)
+			return true;
+
+		nb_node++;
+		if(current->_stored!=nullptr)
+			nb_stored++;
+		if(current==_cursor)
+			cursor_found=true;
+
+		if((lower!=nullptr && compareOp(*lower,current->_op)>=0) || (upper!=nullptr && compareOp(current->_op,*upper)>=0))
+			return false;
+
+		#ifndef TERNARYTREE_LIGHT
+		if(current->father()!=father || current->linkType()!=link_type || current->optimizeInProcess())
+			return false;
+		#else
+		(void)father;
+		(void)link_type;
+		#endif // TERNARYTREE_LIGHT
+
+		size_type nb_smaller=0;
+		size_type nb_greater=0;
+		size_type nb_next=0;
+		if(!checkSubtree(current->_smaller,current,LINK_SMALLER,lower,&current->_op,nb_node,nb_smaller,cursor_found)
+		   || !checkSubtree(current->_greater,current,LINK_GREATER,&current->_op,upper,nb_node,nb_greater,cursor_found)
+		   || !checkSubtree(current->_next,current,LINK_NEXT,nullptr,nullptr,nb_node,nb_next,cursor_found))
+			return false;
+		nb_stored+=nb_smaller+nb_greater+nb_next;
+
+		#ifndef TERNARYTREE_LIGHT
+		if(current->_nb_smaller!=nb_smaller || current->_nb_greater!=nb_greater || current->_nb_next!=nb_next)
+			return false;
+		#endif // TERNARYTREE_LIGHT
+
+		#ifdef TERNARYTREE_SCORED
+		if(current->_max_score!=computeMaxScore(current))
+			return false;
+		#endif // TERNARYTREE_SCORED
+
+		return true;
+	}
+
+	#ifdef TERNARYTREE_PROFILE
+	/*!
+	*\brief Private function.
+	* Return the STORED variable of a range of OP like lookup, and add the moves made in each level to the profile.
+	*\param[in] begin IT : an iterator on the first OP of the range.
+	*\param[in] end IT : the end iterator of the range.
+	*\return const STORED* : the STORED variable, nullptr if the range of OP does not have one.
+	*/
+	template<class IT>
+	const STORED* profiledLookup(IT begin,IT end) const
+	{
+		// the moves of this lookup, added to the profile at the end
+		std::vector<LevelProfile> levels;
+		const STORED* r=nullptr;
+
+		Node* current=_first;
+		while(begin!=end)
+		{
+			LevelProfile level={1,0,0,0,0,0,0};
+			while(current!=nullptr)
+			{
+				int comparison=compareOp(current->_op,*begin);
+				if(comparison==0)
+					break;
+				if(comparison<0)
+				{
+					current=current->_greater;
+					level.nb_greater++;
+				}
+				else
+				{
+					current=current->_smaller;
+					level.nb_smaller++;
+				}
+			}
+			level.longest_walk=level.nb_smaller+level.nb_greater+(current!=nullptr ? 1 : 0);
+
+			if(current==nullptr)
+			{
+				level.nb_missed=1;
+				levels.push_back(level);
+				break;
+			}
+			++begin;
+			if(begin==end)
+			{
+				level.nb_found=1;
+				levels.push_back(level);
+				r=current->_stored;
+				break;
+			}
+			level.nb_next=1;
+			levels.push_back(level);
+			current=current->_next;
+		}
+
+		addToProfile(levels);
+		return r;
+	}
+
+	/*!
+	*\brief Private function.
+	* Works from the subtree pointed by the cursor.
+	* Test if a range of OP is in the subtree's structure like find, and add the moves made in each level to the profile.
+	*\param[in,out] it IT& : an iterator on the first OP of the range, it must be different from end.
+	* On failure it points to the first OP which is not in the structure.
+	*\param[in] end const IT& : the end iterator of the range.
+	*\param[out] link Node**& : on failure, the link of the cursor where the OP pointed by it should be added.
+	*\return bool : true if the range of OP is in the subtree's structure, false if not.
+	*/
+	template<class IT>
+	bool profiledFind(IT& it,const IT& end,Node**& link)
+	{
+		std::vector<LevelProfile> levels;
+		LevelProfile level={1,0,0,0,0,0,0};
+		bool r=false;
+		while(true)
+		{
+			int comparison=compareOp(_cursor->_op,*it);
+
+			if(comparison==0)
+			{
+				level.longest_walk=level.nb_smaller+level.nb_greater+1;
+				++it;
+				if(it==end)
+				{
+					level.nb_found=1;
+					r=true;
+					break;
+				}
+				level.nb_next=1;
+				levels.push_back(level);
+				LevelProfile next_level={1,0,0,0,0,0,0};
+				level=next_level;
+
+				if(_cursor->_next==nullptr)
+				{
+					link=&_cursor->_next;
+					level.nb_missed=1;
+					break;
+				}
+
+				_cursor=_cursor->_next;
+			}
+			else if(comparison<0)
+			{
+				level.nb_greater++;
+				if(_cursor->_greater==nullptr)
+				{
+					link=&_cursor->_greater;
+					level.nb_missed=1;
+					level.longest_walk=level.nb_smaller+level.nb_greater;
+					break;
+				}
+
+				_cursor=_cursor->_greater;
+			}
+			else
+			{
+				level.nb_smaller++;
+				if(_cursor->_smaller==nullptr)
+				{
+					link=&_cursor->_smaller;
+					level.nb_missed=1;
+					level.longest_walk=level.nb_smaller+level.nb_greater;
+					break;
+				}
+
+				_cursor=_cursor->_smaller;
+			}
+		}
+		levels.push_back(level);
+
+		addToProfile(levels);
+		return r;
+	}
+
+	/*!
+	*\brief Private function.
+	* Tell whether the current lookup is sampled, one lookup out of _profile_period being sampled.
+	*\return bool : true if the lookup has to be profiled.
+	*/
+	bool sampleLookup() const
+	{
+		unsigned int period=_profile_period.load(std::memory_order_relaxed);
+		return period!=0 && _profile_counter.fetch_add(1,std::memory_order_relaxed)%period==0;
+	}
+
+	/*!
+	*\brief Private function.
+	* Add the moves of a sampled lookup to the profile.
+	*\param[in] levels const std::vector<LevelProfile>& : the moves made in each level by the lookup.
+	*\return void
+	*/
+	void addToProfile(const std::vector<LevelProfile>& levels) const
+	{
+		std::lock_guard<std::mutex> lock(_profile_mutex);
+		_profile_nb_lookups++;
+		if(_profile.size()<levels.size())
+		{
+			LevelProfile empty={0,0,0,0,0,0,0};
+			_profile.resize(levels.size(),empty);
+		}
+		for(std::size_t i=0;i<levels.size();i++)
+		{
+			_profile[i].nb_visits+=levels[i].nb_visits;
+			_profile[i].nb_smaller+=levels[i].nb_smaller;
+			_profile[i].nb_greater+=levels[i].nb_greater;
+			_profile[i].nb_next+=levels[i].nb_next;
+			_profile[i].nb_found+=levels[i].nb_found;
+			_profile[i].nb_missed+=levels[i].nb_missed;
+			if(levels[i].longest_walk>_profile[i].longest_walk)
+				_profile[i].longest_walk=levels[i].longest_walk;
+		}
+	}
+	#endif // TERNARYTREE_PROFILE
+
+public:
+
+	/*!
+	*\brief Default constructor.
+	*/
+	TernaryTree(void) {}
+
+	/*!
+	*\brief Constructor with a comparator.
+	*\param[in] compare const COMPARE& : the three-way comparator used to sort the OP variables.
+	*/
+	explicit TernaryTree(const COMPARE& compare) : _compare(compare) {}
+
+	/*!
+	*\brief Copy constructor.
+	* Copy all the nodes of the tree. The cursor of the copy points to the root.
+	*\param[in] tree const TernaryTree<OP,STORED,COMPARE>& : the tree to copy.
+	*/
+	TernaryTree(const TernaryTree<OP,STORED,COMPARE>& tree) : _compare(tree._compare)
+	{
+		_first=copyNode(tree._first);
+		_cursor=_first;
+		_nb_node=tree._nb_node;
+		_nb_stored=tree._nb_stored;
+		#ifdef TERNARYTREE_SCORED
+		_score_function=tree._score_function;
+		#endif // TERNARYTREE_SCORED
+		#ifdef TERNARYTREE_PROFILE
+		_profile_period.store(tree._profile_period.load());
+		#endif // TERNARYTREE_PROFILE
+	}
+
+	/*!
+	*\brief Destructor.
+	*/
+	~TernaryTree()
+	{
+		if(_first!=nullptr)
+			delete _first;
+	}
+
+	/*!
+	*\brief Copy assignment operator.
+	* Delete all the nodes of the tree and copy the ones of another tree. The cursor points to the root.
+	*\param[in] tree const TernaryTree<OP,STORED,COMPARE>& : the tree to copy.
+	*\return TernaryTree<OP,STORED,COMPARE>& : the tree.
+	*/
+	TernaryTree<OP,STORED,COMPARE>& operator=(const TernaryTree<OP,STORED,COMPARE>& tree)
+	{
+		if(this!=&tree)
+		{
+			clear();
+			_compare=tree._compare;
+			_first=copyNode(tree._first);
+			_cursor=_first;
+			_nb_node=tree._nb_node;
+			_nb_stored=tree._nb_stored;
+			#ifdef TERNARYTREE_SCORED
+			_score_function=tree._score_function;
+			#endif // TERNARYTREE_SCORED
+			#ifdef TERNARYTREE_PROFILE
+			_profile_period.store(tree._profile_period.load());
+			#endif // TERNARYTREE_PROFILE
+		}
+		return *this;
+	}
+
+	/*!
+	*\brief Save the tree in a stream.
+	* The nodes are written one after the other, so the stream can be a file, a socket or any other std::ostream.
+	*\param[in,out] output std::ostream& : the stream where the tree will be saved.
+	*\param[in] OP_TO_STRING std::string(OP) : a function to cast an OP variable into an std::string.
+	*\param[in] STORED_TO_STRING std::string(STORED) : a function to cast a STORED variable into an std::string.
+	*\param[in] reset_cursor bool : set by default to true. If true the fonction will place the cursor to the root of the tree before starting.
+	*\return void
+	*/
+	void saveToStream(std::ostream& output,std::string OP_TO_STRING(OP),std::string STORED_TO_STRING(STORED),bool reset_cursor=true)
+	{
+		if(reset_cursor)
+			resetCursor();
+		size_type n=0;
+		saveToStream(_cursor,n,0,LINK_ROOT,output,OP_TO_STRING,STORED_TO_STRING);
+	}
+
+	/*!
+	*\brief Save the tree in a file.
+	* An index of the next subtrees of the first level is written at the end of the file, so they can be loaded by several threads.
+	*\param[in] path const std::string& : path to the file where the tree will be saved.
+	*\param[in] OP_TO_STRING std::string(OP) : a function to cast an OP variable into an std::string.
+	*\param[in] STORED_TO_STRING std::string(STORED) : a function to cast a STORED variable into an std::string.
+	*\param[in] reset_cursor bool : set by default to true. If true the fonction will place the cursor to the root of the tree before starting.
+	*\return void
+	*/
+	void saveToFile(const std::string& path,std::string OP_TO_STRING(OP),std::string STORED_TO_STRING(STORED),bool reset_cursor=true)
+	{
+		std::ofstream output_file(path.c_str(),std::ios::binary);
+		if(output_file)
+		{
+			if(reset_cursor)
+				resetCursor();
+			size_type n=0;
+			std::vector<SubtreeIndex> index;
+			saveLevelWithIndex(_cursor,n,0,LINK_ROOT,output_file,OP_TO_STRING,STORED_TO_STRING,index);
+
+			std::streamoff index_at=output_file.tellp();
+			if(index_at>=0)
+			{
+				for(std::size_t i=0;i<index.size();i++)
+				{
+					output_file << "<#> index " << index[i].father_id << " " << index[i].first_id << " " << index[i].nb_node;
+					output_file << " " << static_cast<std::uint64_t>(index[i].begin) << " " << static_cast<std::uint64_t>(index[i].end) << "\n";
+				}
+				// fixed size, so it can be found from the end of the file
+				output_file << "<#> indexat " << std::setw(20) << std::setfill('0') << static_cast<std::uint64_t>(index_at) << "\n";
+			}
+		}
+		output_file.close();
+	}
+
+	/*!
+	*\brief Load a tree from a stream.
+	* The memory used during the loading only depends on the depth of the tree.
+	*\param[in,out] input std::istream& : the stream where the tree is saved.
+	*\param[in] STRING_TO_OP OP(std::string) : a function to cast an std::string  into an OP variable.
+	*\param[in] STRING_TO_STORED STORED(std::string) : a function to cast an std::string  into a STORED variable.
+	*\param[in] PROGRESS void(size_type) : a function called every 65536 loaded nodes and at the end with the number of loaded nodes. Set by default to nullptr.
+	*\return void
+	*/
+	void loadFromStream(std::istream& input,OP STRING_TO_OP(std::string),STORED STRING_TO_STORED(std::string),void PROGRESS(size_type)=nullptr)
+	{
+		clear();
+		std::vector<std::pair<size_type,Node*> > path;
+		loadNodes(input,path,STRING_TO_OP,STRING_TO_STORED,PROGRESS);
+
+		#ifndef TERNARYTREE_LIGHT
+		recount();
+		#endif // TERNARYTREE_LIGHT
+
+		if(PROGRESS!=nullptr)
+			PROGRESS(_nb_node);
+	}
+
+	/*!
+	*\brief Load a tree from a file.
+	* By default the file is loaded by the calling thread only, and the memory used during the loading only depends on the depth of the tree.
+	* If nb_threads is not 1 and the file has been saved with an index, the next subtrees of the first level are loaded by several threads :
+	* the STRING_TO_OP and STRING_TO_STORED functions are then called by those threads at the same time.
+	*\param[in] path const std::string& : path to the file where the tree is saved.
+	*\param[in] STRING_TO_OP OP(std::string) : a function to cast an std::string  into an OP variable.
+	*\param[in] STRING_TO_STORED STORED(std::string) : a function to cast an std::string  into a STORED variable.
+	*\param[in] PROGRESS void(size_type) : a function called by the calling thread with the number of loaded nodes. Set by default to nullptr.
+	*\param[in] nb_threads unsigned int : the number of threads loading the indexed subtrees, 0 to use the number of cores.
+	* Set by default to 1, the file being loaded by the calling thread only.
+	*\return void
+	*/
+	void loadFromFile(const std::string& path,OP STRING_TO_OP(std::string),STORED STRING_TO_STORED(std::string),void PROGRESS(size_type)=nullptr,unsigned int nb_threads=1)
+	{
+		clear();
+		std::ifstream input_file(path.c_str(),std::ios::binary);
+		if(input_file)
+		{
+			if(nb_threads==0)
+				nb_threads=std::thread::hardware_concurrency();
+
+			std::vector<SubtreeIndex> index;
+			if(nb_threads>1 && readIndex(input_file,index) && index.size()>1)
+			{
+				if(nb_threads>index.size())
+					nb_threads=static_cast<unsigned int>(index.size());
+				loadFromFileWithIndex(path,input_file,index,STRING_TO_OP,STRING_TO_STORED,PROGRESS,nb_threads);
+			}
+			else
+			{
+				input_file.clear();
+				input_file.seekg(0);
+				std::vector<std::pair<size_type,Node*> > nodes_path;
+				loadNodes(input_file,nodes_path,STRING_TO_OP,STRING_TO_STORED,PROGRESS);
+			}
+
+			#ifndef TERNARYTREE_LIGHT
+			recount();
+			#endif // TERNARYTREE_LIGHT
+
+			if(PROGRESS!=nullptr)
+				PROGRESS(_nb_node);
+		}
+		input_file.close();
+	}
+
+	/*!
+	*\brief Save the tree in a compressed binary file.
+	* The nodes are written by frames of 65536 nodes in depth-first order : 4 bits per node for the shape of the tree and the STORED variables,
+	* then the OP and the STORED variables converted into std::string. Each part of a frame is compressed by TernaryTreeCodec,
+	* and each frame ends with a CRC-32 checked by loadFromCompressedFile.
+	*\param[in] path const std::string& : path to the file where the tree will be saved.
+	*\param[in] OP_TO_STRING std::string(OP) : a function to cast an OP variable into an std::string.
+	*\param[in] STORED_TO_STRING std::string(STORED) : a function to cast a STORED variable into an std::string.
+	*\param[in] reset_cursor bool : set by default to true. If true the fonction will place the cursor to the root of the tree before starting.
+	*\return void
+	*/
+	void saveToCompressedFile(const std::string& path,std::string OP_TO_STRING(OP),std::string STORED_TO_STRING(STORED),bool reset_cursor=true)
+	{
+		std::ofstream output_file(path.c_str(),std::ios::binary);
+		if(output_file)
+		{
+			if(reset_cursor)
+				resetCursor();
+			output_file.write("TTZ\2",4);
+
+			CompressedFrame frame;
+			frame.nb_node=0;
+			saveToCompressedStream(_cursor,frame,output_file,OP_TO_STRING,STORED_TO_STRING);
+			if(frame.nb_node>0)
+				writeFrame(frame,output_file);
+			// end of the frames
+			output_file.put('\0');
+		}
+		output_file.close();
+	}
+
+	/*!
+	*\brief Load a tree from a compressed binary file written by saveToCompressedFile.
+	* The std::string given to STRING_TO_OP and STRING_TO_STORED are exactly the ones returned by OP_TO_STRING and STORED_TO_STRING.
+	*\param[in] path const std::string& : path to the file where the tree is saved.
+	*\param[in] STRING_TO_OP OP(std::string) : a function to cast an std::string  into an OP variable.
+	*\param[in] STRING_TO_STORED STORED(std::string) : a function to cast an std::string  into a STORED variable.
+	*\return void
+	*/
+	void loadFromCompressedFile(const std::string& path,OP STRING_TO_OP(std::string),STORED STRING_TO_STORED(std::string))
+	{
+		clear();
+		std::ifstream input_file(path.c_str(),std::ios::binary);
+		if(input_file)
+		{
+			char magic[4]={0,0,0,0};
+			input_file.read(magic,4);
+			if(!input_file || std::memcmp(magic,"TTZ\2",4)!=0 || !loadNodesFromCompressedStream(input_file,STRING_TO_OP,STRING_TO_STORED))
+			{
+				clear();
+				throw std::runtime_error("Use of TernaryTree.loadFromCompressedFile() when the file is not a valid compressed file.");
+			}
+
+			#ifndef TERNARYTREE_LIGHT
+			recount();
+			#endif // TERNARYTREE_LIGHT
+		}
+		input_file.close();
+	}
+
+	#ifndef TERNARYTREE_LIGHT
+	/*!
+	*\brief Works from the tree's root.
+	* Optimize the tree's structure to reduce the mean acces time.
+	*\return void
+	*/
+	void optimize()
+	{
+		optimize(_first);
+
+		#ifdef TERNARYTREE_SCORED
+		// the rotations move nodes between subtrees
+		recount();
+		#endif // TERNARYTREE_SCORED
+	}
+
+	/*!
+	*\brief Works from the tree's root.
+	* Return the number of keys which are smaller than a collection of OP, in O(depth).
+	* Keys are the collections of OP having a STORED variable, sorted in lexicographic order
+	* (a key is smaller than the keys it is a prefix of).
+	*\param[in] ops const OP_COL& : the collection of OP, it does not have to be in the tree.
+	*\return size_type : the rank of the collection of OP.
+	*/
+	template<class OP_COL>
+	size_type rank(const OP_COL& ops) const
+	{
+		return rank(opsBegin(ops),opsEnd(ops));
+	}
+
+	/*!
+	*\brief Works from the tree's root.
+	* Return the number of keys k such as lo <= k < hi, in O(depth).
+	*\param[in] lo const OP_COL& : the lower bound, included.
+	*\param[in] hi const OP_COL& : the upper bound, excluded.
+	*\return size_type : the number of keys between lo and hi.
+	*/
+	template<class OP_COL>
+	size_type countRange(const OP_COL& lo,const OP_COL& hi) const
+	{
+		size_type rank_lo=rank(lo);
+		size_type rank_hi=rank(hi);
+		if(rank_hi>rank_lo)
+			return rank_hi-rank_lo;
+		return 0;
+	}
+
+	/*!
+	*\brief Works from the tree's root.
+	* Find the key of rank k, in O(depth).
+	* Set the cursor to the matching node.
+	*\param[in] k size_type : the rank of the key, from 0 to getNbStored()-1.
+	*\param[out] ops std::vector<OP>& : the key of rank k.
+	*\return bool : true if the key exists, false if k is out of range.
+	*/
+	bool select(size_type k,std::vector<OP>& ops)
+	{
+		Node* current=_first;
+		ops.clear();
+
+		while(current!=nullptr)
+		{
+			if(k<current->_nb_smaller)
+			{
+				current=current->_smaller;
+				continue;
+			}
+			k-=current->_nb_smaller;
+
+			if(current->_stored!=nullptr)
+			{
+				if(k==0)
+				{
+					ops.push_back(current->_op);
+					_cursor=current;
+					return true;
+				}
+				k--;
+			}
+
+			if(k<current->_nb_next)
+			{
+				ops.push_back(current->_op);
+				current=current->_next;
+				continue;
+			}
+			k-=current->_nb_next;
+
+			current=current->_greater;
+		}
+		ops.clear();
+		return false;
+	}
+
+	/*!
+	*\brief Works from the tree's root.
+	* Call a function for count keys in increasing order, starting from the key of rank first.
+	* The subtrees before the first key are skipped in O(depth). The cursor is not modified.
+	*\param[in] first size_type : the rank of the first key.
+	*\param[in] count size_type : the maximal number of keys.
+	*\param[in] callback FUNC : a function called as callback(const std::vector<OP>& key,const STORED& stored).
+	*\return void
+	*/
+	template<class FUNC>
+	void selectRange(size_type first,size_type count,FUNC callback) const
+	{
+		std::vector<OP> key;
+		selectRange(_first,key,first,count,callback);
+	}
+
+	/*!
+	*\brief Works from the tree's root.
+	* Call a function for each key k such as lo <= k < hi, in increasing order.
+	* The cursor is not modified.
+	*\param[in] lo const OP_COL& : the lower bound, included.
+	*\param[in] hi const OP_COL& : the upper bound, excluded.
+	*\param[in] callback FUNC : a function called as callback(const std::vector<OP>& key,const STORED& stored).
+	*\return void
+	*/
+	template<class OP_COL,class FUNC>
+	void rangeQuery(const OP_COL& lo,const OP_COL& hi,FUNC callback) const
+	{
+		size_type rank_lo=rank(lo);
+		size_type rank_hi=rank(hi);
+		if(rank_hi>rank_lo)
+			selectRange(rank_lo,rank_hi-rank_lo,callback);
+	}
+
+	/*!
+	*\brief Remove the node pointed by the cursor.
+	* Set the cursor to the root of the tree.
+	*\param[in] ops const OP_COL& : the collection of OP
+	*\param[in] reset_cursor bool : set by default to true. If true the fonction will place the cursor to the root of the tree before starting.
+	*\return bool : true if the tree's structure as been modified, false if the collection of OP was not in the tree's structure.
+	*/
+	void remove()
+	{
+		if(_cursor!=nullptr)
+		{
+			if(_cursor->_stored!=nullptr)
+			{
+				propagateForOptimization(_cursor,-1);
+				delete _cursor->_stored;
+				_cursor->_stored=nullptr;
+				_nb_stored--;
+			}
+			if(_cursor->_next==nullptr)
+			{
+				Node* father=_cursor->father();
+				unlinkNode(_cursor);
+				delete _cursor;
+				_nb_node--;
+
+				// remove the father nodes which are no more used
+				_cursor=father;
+				while(cursorIsOnALeaf() && _cursor->_stored==nullptr)
+				{
+					father=_cursor->father();
+					unlinkNode(_cursor);
+					delete _cursor;
+					_nb_node--;
+					_cursor=father;
+				}
+			}
+
+			#ifdef TERNARYTREE_SCORED
+			updateScores(_cursor);
+			#endif // TERNARYTREE_SCORED
+		}
+		resetCursor();
+	}
+
+	/*!
+	*\brief Remove a range of OP to the tree's structure if it s in.
+	* Set the cursor to the root of the tree.
+	*\param[in] begin IT : an iterator on the first OP of the range.
+	*\param[in] end IT : the end iterator of the range.
+	*\param[in] reset_cursor bool : set by default to true. If true the fonction will place the cursor to the root of the tree before starting.
+	*\return bool : true if the tree's structure as been modified, false if the range of OP was not in the tree's structure.
+	*/
+	template<class IT,typename std::enable_if<IsOpIterator<IT>::value,int>::type=0>
+	bool remove(const IT& begin,const IT& end,bool reset_cursor=true)
+	{
+		if(find(begin,end,reset_cursor))
+		{
+			remove();
+			return true;
+		}
+		return false;
+	}
+
+	/*!
+	*\brief Remove a collection of OP to the tree's structure if it s in.
+	* Set the cursor to the root of the tree.
+	*\param[in] ops const OP_COL& : the collection of OP
+	*\param[in] reset_cursor bool : set by default to true. If true the fonction will place the cursor to the root of the tree before starting.
+	*\return bool : true if the tree's structure as been modified, false if the collection of OP was not in the tree's structure.
+	*/
+	template<class OP_COL>
+	bool remove(const OP_COL& ops, bool reset_cursor=true)
+	{
+		return remove(opsBegin(ops),opsEnd(ops),reset_cursor);
+	}
+
+	#ifdef TERNARYTREE_SCORED
+	/*!
+	*\brief Set the function giving the score of a STORED variable, used by topK.
+	* The greatest score of each subtree is computed again, in one pass over the tree.
+	*\param[in] SCORE double(const STORED&) : the function.
+	*\return void
+	*/
+	void setScoreFunction(double SCORE(const STORED&))
+	{
+		_score_function=SCORE;
+		recount();
+	}
+
+	/*!
+	*\brief Works from the tree's root.
+	* Report the k keys starting with a range of OP which have the greatest scores, from the greatest to the smallest score.
+	* The subtrees are visited by decreasing greatest score, and the search stops after the k-th key.
+	* The cursor is not modified.
+	* Throw an std::runtime_error exception if no score function has been set.
+	*\param[in] begin IT : an iterator on the first OP of the prefix.
+	*\param[in] end IT : the end iterator of the prefix.
+	*\param[in] k size_type : the number of keys.
+	*\param[in] callback FUNC : a function called as callback(const std::vector<OP>& key,const STORED& stored).
+	*\return void
+	*/
+	template<class IT,class FUNC>
+	void topK(IT begin,IT end,size_type k,FUNC callback) const
+	{
+		if(_score_function==nullptr)
+			throw std::runtime_error("Use of TernaryTree.topK() when no score function has been set.");
+
+		std::vector<OP> prefix;
+		Node* prefix_node=nullptr;
+		Node* search_root=_first;
+		for(;begin!=end;++begin)
+		{
+			prefix_node=findInLevel(search_root,*begin);
+			if(prefix_node==nullptr)
+				return;
+			prefix.push_back(*begin);
+			search_root=prefix_node->_next;
+		}
+
+		std::priority_queue<ScoredCandidate> candidates;
+		if(prefix_node!=nullptr && prefix_node->_stored!=nullptr)
+		{
+			ScoredCandidate candidate={ownScore(prefix_node),prefix_node,false};
+			candidates.push(candidate);
+		}
+		if(search_root!=nullptr)
+		{
+			ScoredCandidate candidate={search_root->_max_score,search_root,true};
+			candidates.push(candidate);
+		}
+
+		std::vector<OP> key;
+		std::vector<OP> suffix;
+		while(k>0 && !candidates.empty())
+		{
+			ScoredCandidate best=candidates.top();
+			candidates.pop();
+			Node* current=best.node;
+
+			if(!best.subtree)
+			{
+				// the end of the key is made of the OP of the nodes left by their next link, from current up to search_root
+				suffix.clear();
+				if(current!=prefix_node)
+				{
+					Node* node=current;
+					suffix.push_back(node->_op);
+					while(node!=search_root)
+					{
+						unsigned int link_type=node->linkType();
+						node=node->father();
+						if(link_type==LINK_NEXT)
+							suffix.push_back(node->_op);
+					}
+				}
+				key=prefix;
+				key.insert(key.end(),suffix.rbegin(),suffix.rend());
+				callback(key,*current->_stored);
+				k--;
+				continue;
+			}
+
+			if(current->_stored!=nullptr)
+			{
+				ScoredCandidate candidate={ownScore(current),current,false};
+				candidates.push(candidate);
+			}
+			Node* children[3]={current->_smaller,current->_greater,current->_next};
+			for(unsigned int i=0;i<3;i++)
+			{
+				if(children[i]!=nullptr)
+				{
+					ScoredCandidate candidate={children[i]->_max_score,children[i],true};
+					candidates.push(candidate);
+				}
+			}
+		}
+	}
+	#endif // TERNARYTREE_SCORED
+	#endif // TERNARYTREE_OPTIMIZE_UNABLE
+
+	/*!
+	*\brief Delete all the tree's node.
+	*\return void
+	*/
+	void clear()
+	{
+		if(_first!=nullptr)
+			delete _first;
+		_first=nullptr;
+		_cursor=nullptr;
+		_nb_node=0;
+		_nb_stored=0;
+	}
+
+	/*!
+	*\brief Move all the keys of another tree into the tree.
+	* The levels of both trees are walked together : a subtree which is only in the other tree is moved as it is,
+	* the nodes having the same OP are merged, and each merged level is rebuilt balanced. The other tree is left empty.
+	* Set the cursor to the root of the tree.
+	*\param[in,out] other TernaryTree<OP,STORED,COMPARE>& : the other tree, empty after the merge.
+	*\param[in] policy MergePolicy : set by default to KEEP_OTHER. The STORED variable kept when a key is in both trees.
+	*\return void
+	*/
+	void merge(TernaryTree<OP,STORED,COMPARE>& other,MergePolicy policy=KEEP_OTHER)
+	{
+		merge(other,policy,nullptr);
+	}
+
+	/*!
+	*\brief Move all the keys of another tree into the tree.
+	* The levels of both trees are walked together : a subtree which is only in the other tree is moved as it is,
+	* the nodes having the same OP are merged, and each merged level is rebuilt balanced. The other tree is left empty.
+	* Set the cursor to the root of the tree.
+	*\param[in,out] other TernaryTree<OP,STORED,COMPARE>& : the other tree, empty after the merge.
+	*\param[in] RESOLVE STORED(const STORED&,const STORED&) : a function called as RESOLVE(current,other) when a key is in both trees, returning the kept STORED variable.
+	*\return void
+	*/
+	void merge(TernaryTree<OP,STORED,COMPARE>& other,STORED RESOLVE(const STORED&,const STORED&))
+	{
+		merge(other,KEEP_OTHER,RESOLVE);
+	}
+
+	/*!
+	*\brief Keep only the keys which are also in another tree, with their STORED variable of the tree.
+	* The levels of both trees are walked together, the subtrees which are not in the other tree are deleted as a whole.
+	* Set the cursor to the root of the tree.
+	*\param[in] other const TernaryTree<OP,STORED,COMPARE>& : the other tree.
+	*\return void
+	*/
+	void intersect(const TernaryTree<OP,STORED,COMPARE>& other)
+	{
+		if(&other!=this)
+			filter(other,true);
+		resetCursor();
+	}
+
+	/*!
+	*\brief Remove the keys which are in another tree.
+	* The levels of both trees are walked together, the subtrees which are not in the other tree are kept as they are.
+	* Set the cursor to the root of the tree.
+	*\param[in] other const TernaryTree<OP,STORED,COMPARE>& : the other tree.
+	*\return void
+	*/
+	void difference(const TernaryTree<OP,STORED,COMPARE>& other)
+	{
+		if(&other!=this)
+			filter(other,false);
+		else
+			clear();
+		resetCursor();
+	}
+
+	/*!
+	*\class BulkInserter ternarytree.hpp "ternarytree.hpp"
+	*\brief A class to add many keys to a tree, faster when the keys are sorted.
+	* The path of the previous key is kept, so each key is added from the end of its common prefix with the previous one
+	* instead of from the root. When the keys are sorted, a new OP of a level is added directly after the greatest node of the level.
+	* The optimization's variables are computed once, when finish is called or when the BulkInserter is destroyed.
+	* The tree must not be modified by other functions while a BulkInserter is used on it.
+	*/
+	class BulkInserter
+	{
+	private:
+
+		TernaryTree<OP,STORED,COMPARE>& _tree;
+
+		// the previous key, the node of each of its OP,
+		// and whether each of those nodes is the greatest of its level
+		std::vector<OP> _key;
+		std::vector<Node*> _path;
+		std::vector<bool> _greatest;
+
+		bool _pending=false;
+
+	public:
+
+		/*!
+		*\brief Constructor.
+		*\param[in,out] tree TernaryTree<OP,STORED,COMPARE>& : the tree where the keys will be added.
+		*/
+		explicit BulkInserter(TernaryTree<OP,STORED,COMPARE>& tree) : _tree(tree) {}
+
+		BulkInserter(const BulkInserter&)=delete;
+		BulkInserter& operator=(const BulkInserter&)=delete;
+
+		/*!
+		*\brief Destructor.
+		* Call finish.
+		*/
+		~BulkInserter()
+		{
+			finish();
+		}
+
+		/*!
+		*\brief Add a range of OP to the tree's structure if it s not already in and set its STORED variable.
+		* Throw an std::runetime_error exception if the range is empty.
+		*\param[in] begin IT : an iterator on the first OP of the range.
+		*\param[in] end IT : the end iterator of the range.
+		*\param[in] stored STORED : the STORED variable.
+		*\return bool : true if the tree's structure as been modified, false if the range of OP was already in the tree's structure.
+		*/
+		template<class IT>
+		bool add(IT begin,IT end,STORED stored)
+		{
+			if(begin==end)
+				throw std::runtime_error("Use of TernaryTree::BulkInserter.add() with an empty collection of OP.");
+
+			// common prefix with the previous key
+			std::size_t depth=0;
+			while(depth<_key.size() && begin!=end && _tree.compareOp(_key[depth],*begin)==0)
+			{
+				++depth;
+				++begin;
+			}
+
+			Node* previous=nullptr;
+			bool previous_greatest=false;
+			if(depth<_path.size())
+			{
+				previous=_path[depth];
+				previous_greatest=_greatest[depth];
+			}
+			_key.resize(depth);
+			_path.resize(depth);
+			_greatest.resize(depth);
+
+			bool modified=false;
+			while(begin!=end)
+			{
+				Node* current;
+				bool greatest=true;
+
+				if(previous!=nullptr && previous_greatest && _tree.compareOp(previous->_op,*begin)<0)
+				{
+					// sorted keys : after the greatest node of the level
+					current=_tree.createNode(&previous->_greater,previous,LINK_GREATER,*begin);
+					modified=true;
+				}
+				else
+				{
+					Node* father=nullptr;
+					unsigned int link_type=LINK_ROOT;
+					Node** link=&_tree._first;
+					if(depth>0)
+					{
+						father=_path[depth-1];
+						link_type=LINK_NEXT;
+						link=&father->_next;
+					}
+
+					while((*link)!=nullptr)
+					{
+						int comparison=_tree.compareOp((*link)->_op,*begin);
+						if(comparison==0)
+							break;
+						father=(*link);
+						if(comparison<0)
+						{
+							link_type=LINK_GREATER;
+							link=&father->_greater;
+						}
+						else
+						{
+							link_type=LINK_SMALLER;
+							link=&father->_smaller;
+							greatest=false;
+						}
+					}
+
+					if((*link)==nullptr)
+					{
+						current=_tree.createNode(link,father,link_type,*begin);
+						modified=true;
+					}
+					else
+						current=(*link);
+					greatest=greatest && current->_greater==nullptr;
+				}
+
+				_key.push_back(*begin);
+				_path.push_back(current);
+				_greatest.push_back(greatest);
+				previous=nullptr;
+				++begin;
+				++depth;
+			}
+
+			Node* node=_path[depth-1];
+			if(node->_stored==nullptr)
+			{
+				node->_stored=new STORED(stored);
+				_tree._nb_stored++;
+				_pending=true;
+			}
+			else
+			{
+				(*node->_stored)=stored;
+
+				#ifdef TERNARYTREE_SCORED
+				// the new score may change the greatest scores of the subtrees
+				_pending=true;
+				#endif // TERNARYTREE_SCORED
+			}
+
+			return modified;
+		}
+
+		/*!
+		*\brief Add a collection of OP to the tree's structure if it s not already in and set its STORED variable.
+		* Throw an std::runetime_error exception if the collection is empty.
+		*\param[in] ops const OP_COL& : the collection of OP.
+		*\param[in] stored STORED : the STORED variable.
+		*\return bool : true if the tree's structure as been modified, false if the collection of OP was already in the tree's structure.
+		*/
+		template<class OP_COL>
+		bool add(const OP_COL& ops,STORED stored)
+		{
+			return add(opsBegin(ops),opsEnd(ops),stored);
+		}
+
+		/*!
+		*\brief Compute the optimization's variables of the tree, and the greatest scores with TERNARYTREE_SCORED, in one pass over the tree.
+		* Must be called before using optimize, remove, the ordered queries or topK on the tree.
+		*\return void
+		*/
+		void finish()
+		{
+			#ifndef TERNARYTREE_LIGHT
+			if(_pending)
+				_tree.recount();
+			#endif // TERNARYTREE_LIGHT
+			_pending=false;
+		}
+	};
+
+	/*!
+	*\brief Add a range of keys and their STORED variables with a BulkInserter.
+	* Faster than add when the keys are sorted.
+	*\param[in] begin IT : an iterator on the first key, *begin is an std::pair<OP_COL,STORED>.
+	*\param[in] end IT : the end iterator of the keys.
+	*\return void
+	*/
+	template<class IT>
+	void insertBatch(IT begin,IT end)
+	{
+		BulkInserter inserter(*this);
+		for(;begin!=end;++begin)
+			inserter.add(begin->first,begin->second);
+	}
+
+	/*!
+	*\brief Add a range of OP to the tree's structure if it s not already in.
+	* Set the cursor to the matching node.
+	* Throw an std::runetime_error exception if the range is empty.
+	* reset_cursor has to be a bool, so a call like add(begin,end,"value") always goes to the overload taking a STORED variable.
+	*\param[in] begin IT : an iterator on the first OP of the range.
+	*\param[in] end IT : the end iterator of the range.
+	*\param[in] reset_cursor bool : set by default to true. If true the fonction will place the cursor to the root of the tree before starting.
+	*\return bool : true if the tree's structure as been modified, false if the range of OP was already in the tree's structure.
+	*/
+	template<class IT,class BOOL=bool,typename std::enable_if<IsOpIterator<IT>::value && std::is_same<BOOL,bool>::value,int>::type=0>
+	bool add(const IT& begin,const IT& end,BOOL reset_cursor=true)
+	{
+		if(begin==end)
+			throw std::runtime_error("Use of TernaryTree.add() with an empty collection of OP.");
+
+		if(reset_cursor)
+			resetCursor();
+
+		IT it=begin;
+		Node** link;
+		if(!find(it,end,link))
+		{
+			if(_first==nullptr) // add to first (empty tree)
+				_cursor=createNode(&_first,nullptr,LINK_ROOT,*it);
+			else if(link==&_cursor->_greater) //add to greater
+				_cursor=createNode(link,_cursor,LINK_GREATER,*it);
+			else if(link==&_cursor->_smaller) // add to smaller
+				_cursor=createNode(link,_cursor,LINK_SMALLER,*it);
+			else // add to next
+				_cursor=createNode(link,_cursor,LINK_NEXT,*it);
+			++it;
+			while(it!=end)
+			{
+				_cursor=createNode(&_cursor->_next,_cursor,LINK_NEXT,*it);
+				++it;
+			}
+
+			return true;
+		}
+
+		return false;
+	}
+
+	/*!
+	*\brief Add a collection of OP to the tree's structure if it s not already in.
+	* Set the cursor to the matching node.
+	* Throw an std::runetime_error exception if the collection is empty.
+	* reset_cursor has to be a bool, so a call like add(key,"value") always goes to the overload taking a STORED variable.
+	*\param[in] ops const OP_COL& : the collection of OP
+	*\param[in] reset_cursor bool : set by default to true. If true the fonction will place the cursor to the root of the tree before starting.
+	*\return bool : true if the tree's structure as been modified, false if the collection of OP was already in the tree's structure.
+	*/
+	template<class OP_COL,class BOOL=bool,typename std::enable_if<std::is_same<BOOL,bool>::value,int>::type=0>
+	bool add(const OP_COL& ops, BOOL reset_cursor=true)
+	{
+		return add(opsBegin(ops),opsEnd(ops),reset_cursor);
+	}
+
+	/*!
+	*\brief Set the STORED variable of the node pointed by the cursor.
+	* Throw an std::runetime_error exception if the tree is empty.
+	*\param[in] stored STORED : the STORED variable.
+	*\return void
+	*/
+	void set(STORED stored)
+	{
+		if(_cursor==nullptr)
+			throw std::runtime_error("Use of TernaryTree.set(const STORED& stored) when the tree is empty.");
+		if(_cursor->_stored==nullptr)
+		{
+			_cursor->_stored=new STORED;
+			_nb_stored++;
+
+			#ifndef TERNARYTREE_LIGHT
+			propagateForOptimization(_cursor,1);
+			#endif // TERNARYTREE_LIGHT
+		}
+		(*_cursor->_stored)=stored;
+
+		#ifdef TERNARYTREE_SCORED
+		updateScores(_cursor);
+		#endif // TERNARYTREE_SCORED
+	}
+
+	/*!
+	*\brief Add a range of OP to the tree's structure if it s not already in.
+	* Set the cursor to the matching node.
+	* Set the STORED variable of the node pointed by the cursor
+	*\param[in] begin IT : an iterator on the first OP of the range.
+	*\param[in] end IT : the end iterator of the range.
+	*\param[in] stored STORED : the STORED variable
+	*\param[in] reset_cursor bool : set by default to true. If true the fonction will place the cursor to the root of the tree before starting.
+	*\return bool : true if the tree's structure as been modified, false if the range of OP was already in the tree's structure.
+	*/
+	template<class IT,typename std::enable_if<IsOpIterator<IT>::value,int>::type=0>
+	bool add(const IT& begin,const IT& end,STORED stored,bool reset_cursor=true)
+	{
+		bool r_bool=add(begin,end,reset_cursor);
+		set(stored);
+		return r_bool;
+	}
+
+	/*!
+	*\brief Add a collection of OP to the tree's structure if it s not already in.
+	* Set the cursor to the matching node.
+	* Set the STORED variable of the node pointed by the cursor
+	*\param[in] ops const OP_COL& : the collection of OP
+	*\param[in] stored STORED : the STORED variable
+	*\param[in] reset_cursor bool : set by default to true. If true the fonction will place the cursor to the root of the tree before starting.
+	*\return bool : true if the tree's structure as been modified, false if the collection of OP was already in the tree's structure.
+	*/
+	template<class OP_COL>
+	bool add(const OP_COL& ops,STORED stored, bool reset_cursor=true)
+	{
+		return add(opsBegin(ops),opsEnd(ops),stored,reset_cursor);
+	}
+
+	/*!
+	*\brief Set the cursor to the root of the tree.
+	*\return void
+	*/
+	void resetCursor()
+	{
+		_cursor=_first;
+	}
+
+	/*!
+	*\brief Test if a range of OP is in the tree's structure.
+	* Set the cursor to the best matching node.
+	* Any iterator can be used, including pointers on a buffer and single-pass iterators.
+	*\param[in] begin IT : an iterator on the first OP of the range.
+	*\param[in] end IT : the end iterator of the range.
+	*\param[in] reset_cursor bool : set by default to true. If true the fonction will place the cursor to the root of the tree before starting.
+	*\return bool : true if the range of OP is in the tree's structure, false if not or if the range is empty.
+	*/
+	template<class IT,typename std::enable_if<IsOpIterator<IT>::value,int>::type=0>
+	bool find(const IT& begin,const IT& end,bool reset_cursor=true)
+	{
+		if(reset_cursor)
+			resetCursor();
+		if(begin==end)
+			return false;
+		IT it=begin;
+		Node** link;
+		return find(it,end,link);
+	}
+
+	/*!
+	*\brief Test if a collection of OP is in the tree's structure.
+	* Set the cursor to the best matching node.
+	* Any collection with begin() and end() can be used, like std::basic_string_view or std::span.
+	*\param[in] ops const OP_COL& : the collection of OP
+	*\param[in] reset_cursor bool : set by default to true. If true the fonction will place the cursor to the root of the tree before starting.
+	*\return bool : true if the collection of OP is in the tree's structure, false if not.
+	*/
+	template<class OP_COL>
+	bool find(const OP_COL& ops, bool reset_cursor=true)
+	{
+		return find(opsBegin(ops),opsEnd(ops),reset_cursor);
+	}
+
+	/*!
+	*\brief Works from the tree's root.
+	* Return the STORED variable of a range of OP without moving the cursor,
+	* so it can be used on a const tree and by several threads at the same time.
+	*\param[in] begin IT : an iterator on the first OP of the range.
+	*\param[in] end IT : the end iterator of the range.
+	*\return const STORED* : the STORED variable, nullptr if the range of OP does not have one.
+	*/
+	template<class IT>
+	const STORED* lookup(IT begin,IT end) const
+	{
+		#ifdef TERNARYTREE_PROFILE
+		if(sampleLookup())
+			return profiledLookup(begin,end);
+		#endif // TERNARYTREE_PROFILE
+
+		Node* current=_first;
+		while(begin!=end)
+		{
+			current=findInLevel(current,*begin);
+			if(current==nullptr)
+				return nullptr;
+			++begin;
+			if(begin==end)
+				return current->_stored;
+			current=current->_next;
+		}
+		return nullptr;
+	}
+
+	/*!
+	*\brief Works from the tree's root.
+	* Return the STORED variable of a collection of OP without moving the cursor,
+	* so it can be used on a const tree and by several threads at the same time.
+	*\param[in] ops const OP_COL& : the collection of OP.
+	*\return const STORED* : the STORED variable, nullptr if the collection of OP does not have one.
+	*/
+	template<class OP_COL>
+	const STORED* lookup(const OP_COL& ops) const
+	{
+		return lookup(opsBegin(ops),opsEnd(ops));
+	}
+
+	/*!
+	*\brief Works from the tree's root.
+	* Report every key of the tree occurring in a text, in one pass over the text.
+	* The cursor is not modified.
+	* If longest_match is false, every occurrence is reported (overlapping ones included), ordered by end position.
+	* A set of active walks is kept, one for each start position which is still the prefix of a key.
+	* If longest_match is true, the text is read from left to right, only the longest key starting at the current position is reported
+	* and the scan resumes after it.
+	*\param[in] begin IT : a forward iterator on the first OP of the text.
+	*\param[in] end IT : the end iterator of the text.
+	*\param[in] callback FUNC : a function called as callback(IT match_begin,IT match_end,const STORED& stored) for each match.
+	*\param[in] longest_match bool : set by default to false. If true only the longest non-overlapping matches are reported.
+	*\return void
+	*/
+	template<class IT,class FUNC>
+	void scanText(IT begin,IT end,FUNC callback,bool longest_match=false) const
+	{
+		if(_first==nullptr)
+			return;
+
+		if(longest_match)
+		{
+			while(begin!=end)
+			{
+				Node* level=_first;
+				Node* match=nullptr;
+				IT match_end=begin;
+				IT it=begin;
+				while(it!=end && level!=nullptr)
+				{
+					Node* current=findInLevel(level,*it);
+					if(current==nullptr)
+						break;
+					++it;
+					if(current->_stored!=nullptr)
 					{
-						if(str_op=="")
-							str_op+=r_str;
-						else
-							str_op+=" "+r_str;
-						input_file >> r_str;
+						match=current;
+						match_end=it;
 					}
-					dont_read=true;
+					level=current->_next;
 				}
-				else if(r_str=="data")
+				if(match!=nullptr)
 				{
-					input_file >> r_str;
-					while(r_str!="<#>")
-					{
-						if(str_stored=="")
-							str_stored+=r_str;
-						else
-							str_stored+=" "+r_str;
-						input_file >> r_str;
-					}
-					dont_read=true;
+					const STORED& stored=*match->_stored;
+					callback(begin,match_end,stored);
+					begin=match_end;
 				}
-				else if(r_str=="end")
+				else
+					++begin;
+			}
+		}
+		else
+		{
+			std::vector<std::pair<IT,Node*> > active;
+			std::vector<std::pair<IT,Node*> > still_active;
+			for(IT it=begin;it!=end;)
+			{
+				IT it_end=it;
+				++it_end;
+				active.push_back(std::make_pair(it,_first));
+				for(typename std::vector<std::pair<IT,Node*> >::const_iterator walk=active.begin();walk!=active.end();++walk)
 				{
-					switch(link_type)
+					Node* current=findInLevel(walk->second,*it);
+					if(current!=nullptr)
 					{
-					case 0: //root
-						_first=new Node();
-						nodes.push_back(_first);
-						break;
+						if(current->_stored!=nullptr)
+						{
+							const STORED& stored=*current->_stored;
+							callback(walk->first,it_end,stored);
+						}
+						if(current->_next!=nullptr)
+							still_active.push_back(std::make_pair(walk->first,current->_next));
+					}
+				}
+				active.swap(still_active);
+				still_active.clear();
+				it=it_end;
+			}
+		}
+	}
+
+	/*!
+	*\brief Works from the subtree pointed by the cursor.
+	* Put the cursor to the greater node if it exist.
+	*\return bool : true if the cursor has been modify, false if not.
+	*/
+	bool moveToGreater()
+	{
+		if(_cursor==nullptr || _cursor->_greater==nullptr)
+			return false;
+		_cursor=_cursor->_greater;
+		return true;
+	}
+
+	/*!
+	*\brief Works from the subtree pointed by the cursor.
+	* Put the cursor to the smaller node if it exist.
+	*\return bool : true if the cursor has been modify, false if not.
+	*/
+	bool moveToSmaller()
+	{
+		if(_cursor==nullptr || _cursor->_smaller==nullptr)
+			return false;
+		_cursor=_cursor->_smaller;
+		return true;
+	}
+
+	/*!
+	*\brief Works from the subtree pointed by the cursor.
+	* Put the cursor to the next node if it exist.
+	*\return bool : true if the cursor has been modify, false if not.
+	*/
+	bool moveToNext()
+	{
+		if(_cursor==nullptr || _cursor->_next==nullptr)
+			return false;
+		_cursor=_cursor->_next;
+		return true;
+	}
+
+	/*!
+	*\brief Works from the subtree pointed by the cursor.
+	* Test if the node has a STORED variable.
+	*\return bool : true if the greater node exist, false if not.
+	*/
+	bool hasAStored()
+	{
+		return !(_cursor->_stored==nullptr);
+	}
+
+	/*!
+	*\brief Test if the cursor point to a leaf.
+	*\return bool : true if the cursor point to a leaf, false if not.
+	*/
+	bool cursorIsOnALeaf()
+	{
+		if(_cursor!=nullptr)
+			return _cursor->_greater==nullptr && _cursor->_smaller==nullptr && _cursor->_next==nullptr;
+		return false;
+	}
+
+	/*!
+	*\brief Works from the root of the tree.
+	* Test if the tree is empty.
+	*\return bool : true if the tree is empty, false if not.
+	*/
+	bool isEmpty() const
+	{
+		return _first==nullptr;
+	}
+
+	/*!
+	*\brief Works from the root of the tree.
+	* Check the invariants of the tree's structure, in one pass over the tree :
+	* the OP of each level are sorted, the numbers of nodes and of STORED variables are right, the cursor is a node of the tree,
+	* and, for trees which are not light, the fathers and the optimization's variables (and the scores if TERNARYTREE_SCORED is defined) are right.
+	* Meant to be called by tests after each modification of the tree.
+	*\return bool : true if the invariants hold, false if the tree is corrupted.
+	*/
+	bool checkIntegrity() const
+	{
+		size_type nb_node=0;
+		size_type nb_stored=0;
+		bool cursor_found=(_cursor==nullptr);
+		if(!checkSubtree(_first,nullptr,LINK_ROOT,nullptr,nullptr,nb_node,nb_stored,cursor_found))
+			return false;
+		return nb_node==_nb_node && nb_stored==_nb_stored && cursor_found;
+	}
+
+	#ifdef TERNARYTREE_PROFILE
+	/*!
+	*\brief Set how often the lookups are profiled : the ones made by lookup, and the walks of find, add and remove
+	* (so also the ones of ShardedTernaryTree). It can be called while other threads use lookup.
+	* A sampled lookup adds to the profile the number of moves to the smaller, greater and next nodes it made in each level.
+	*\param[in] period unsigned int : one lookup out of period is sampled, 0 to stop profiling.
+	*\return void
+	*/
+	void setProfileSampling(unsigned int period)
+	{
+		_profile_period.store(period);
+	}
+
+	/*!
+	*\brief Forget all the sampled lookups.
+	*\return void
+	*/
+	void resetProfile()
+	{
+		std::lock_guard<std::mutex> lock(_profile_mutex);
+		_profile_nb_lookups=0;
+		_profile.clear();
+	}
+
+	/*!
+	*\brief Write the profile as a JSON object : the number of sampled lookups, and for each level the number of visits,
+	* of moves to the smaller and to the greater nodes, of lookups going to the next level, ending in the level or missing the OP,
+	* the number of comparisons, and the greatest number of comparisons of one lookup in the level.
+	*\param[in,out] output std::ostream& : the stream where the profile is written.
+	*\return void
+	*/
+	void saveProfileToJson(std::ostream& output) const
+	{
+		std::lock_guard<std::mutex> lock(_profile_mutex);
+		output << "{\"sampled_lookups\":" << _profile_nb_lookups << ",\"levels\":[";
+		for(std::size_t i=0;i<_profile.size();i++)
+		{
+			const LevelProfile& level=_profile[i];
+			if(i>0)
+				output << ",";
+			output << "\n{\"level\":" << i;
+			output << ",\"visits\":" << level.nb_visits;
+			output << ",\"smaller\":" << level.nb_smaller;
+			output << ",\"greater\":" << level.nb_greater;
+			output << ",\"next\":" << level.nb_next;
+			output << ",\"found\":" << level.nb_found;
+			output << ",\"missed\":" << level.nb_missed;
+			output << ",\"comparisons\":" << level.nb_smaller+level.nb_greater+level.nb_next+level.nb_found;
+			output << ",\"longest_walk\":" << level.longest_walk << "}";
+		}
+		output << "]}\n";
+	}
 
-					case 1: //smaller
-						nodes[father_id]->_smaller=new Node();
-						nodes.push_back(nodes[father_id]->_smaller);
+	/*!
+	*\brief Write the profile as folded stacks, one line per level and kind of comparison, weighted by the number of comparisons.
+	* The file can be given to flame graph tools : each level is a frame above the previous one, with the smaller, greater and match frames on top.
+	*\param[in,out] output std::ostream& : the stream where the profile is written.
+	*\return void
+	*/
+	void saveProfileToFoldedStacks(std::ostream& output) const
+	{
+		std::lock_guard<std::mutex> lock(_profile_mutex);
+		std::string stack;
+		for(std::size_t i=0;i<_profile.size();i++)
+		{
+			const LevelProfile& level=_profile[i];
+			if(i>0)
+				stack+=";";
+			stack+="level "+std::to_string(i);
+			if(level.nb_smaller>0)
+				output << stack << ";smaller " << level.nb_smaller << "\n";
+			if(level.nb_greater>0)
+				output << stack << ";greater " << level.nb_greater << "\n";
+			if(level.nb_next+level.nb_found>0)
+				output << stack << ";match " << level.nb_next+level.nb_found << "\n";
+		}
+	}
+	#endif // TERNARYTREE_PROFILE
 
-						#ifndef TERNARYTREE_LIGHT
-						nodes.back()->_father_link=&nodes[father_id]->_smaller;
-						nodes.back()->_father_nb=(&nodes[father_id]->_nb_smaller);
-						#endif // TERNARYTREE_LIGHT
+	/*!
+	*\brief Works from the subtree pointed by the cursor.
+	* Test if the greater node exist.
+	*\return bool : true if the greater node exist, false if not.
+	*/
+	bool greaterExist()
+	{
+		return !_cursor->_greater==nullptr;
+	}
 
-						break;
+	/*!
+	*\brief Works from the subtree pointed by the cursor.
+	* Test if the next node exist.
+	*\return bool : true if the smaller node exist, false if not.
+	*/
+	bool smallerExist()
+	{
+		return !_cursor->_smaller==nullptr;
+	}
 
-					case 2: //greater
-						nodes[father_id]->_greater=new Node();
-						nodes.push_back(nodes[father_id]->_greater);
+	/*!
+	*\brief Works from the subtree pointed by the cursor.
+	* Test if the greater node exist.
+	*\return bool : true if the next node exist, false if not.
+	*/
+	bool nextExist()
+	{
+		return !_cursor->_next==nullptr;
+	}
 
-						#ifndef TERNARYTREE_LIGHT
-						nodes.back()->_father_link=&nodes[father_id]->_greater;
-						nodes.back()->_father_nb=(&nodes[father_id]->_nb_greater);
-						#endif // TERNARYTREE_LIGHT
+	/*!
+	*\brief Return the tree's number of node.
+	*\return size_type : the number of node.
+	*/
+	size_type getNbNode() const
+	{
+		return _nb_node;
+	}
 
-						break;
+	/*!
+	*\brief Return the number of STORED variable in the tree.
+	*\return size_type : the number of STORED variable.
+	*/
+	size_type getNbStored() const
+	{
+		return _nb_stored;
+	}
 
-					case 3: //next
-						nodes[father_id]->_next=new Node();
-						nodes.push_back(nodes[father_id]->_next);
+	/*!
+	*\brief Return the STORED variable of the node pointed by the cursor.
+	* Throw an std::runetime_error exception if the STORED variable does not exist.
+	*\return STORED : the STORED variable.
+	*/
+	STORED get()
+	{
+		if(_cursor!=nullptr)
+		{
+			if(_cursor->_stored!=nullptr)
+				return (*_cursor->_stored);
+			throw std::runtime_error("Use of TernaryTree.get() when the node does not have a STORED variable.");
+		}
+		throw std::runtime_error("Use of TernaryTree.get() when the tree is empty.");
+	}
 
-						#ifndef TERNARYTREE_LIGHT
-						nodes.back()->_father_link=&nodes[father_id]->_next;
-						nodes.back()->_father_nb=(&nodes[father_id]->_nb_next);
-						#endif // TERNARYTREE_LIGHT
+	/*!
+	*\brief Return the OP variable of the node pointed by the cursor.
+	* Throw an std::runetime_error exception if the OP variable does not exist.
+	*\return OP : the OP variable.
+	*/
+	OP getOp()
+	{
+		if(_cursor!=nullptr)
+			return _cursor->_op;
+		throw std::runtime_error("Use of TernaryTree.getOp() when the tree is empty.");
+	}
 
-						break;
+	/*!
+	*\brief Return the STORED variable of the node at the root.
+	* Throw an std::runetime_error exception if the STORED variable does not exist.
+	*\return STORED : the STORED variable.
+	*/
+	STORED getFirst()
+	{
+		if(_first!=nullptr)
+		{
+			if(_first->_stored!=nullptr)
+				return (*_first->_stored);
+			throw std::runtime_error("Use of TernaryTree.getFirst() when the root does not have a STORED variable.");
+		}
+		throw std::runtime_error("Use of TernaryTree.getFirst() when the tree is empty.");
+	}
 
-					default:
-						//not supposed to go here
-						break;
-					}
+	/*!
+	*\brief Return the OP variable of the node at the root.
+	* Throw an std::runetime_error exception if the OP variable does not exist.
+	*\return OP : the OP variable.
+	*/
+	OP getFirstOp()
+	{
+		if(_first!=nullptr)
+			return _first->_op;
+		throw std::runtime_error("Use of TernaryTree.getFirstOp() when the tree is empty.");
+	}
 
-					#ifndef TERNARYTREE_LIGHT
-					nodes.back()->_father=nodes[father_id];
-					#endif // TERNARYTREE_LIGHT
+	/*!
+	*\brief Return the STORED variable of the greater node of the node pointed by the cursor.
+	* Throw an std::runetime_error exception if the STORED variable does not exist.
+	*\return STORED : the STORED variable.
+	*/
+	STORED getGreater()
+	{
+		if(_cursor!=nullptr)
+		{
+			if(_cursor->_greater!=nullptr)
+			{
+				if(_cursor->_greater->_stored!=nullptr)
+					return (*_cursor->_greater->_stored);
+				throw std::runtime_error("Use of TernaryTree.getGreater() when the greater node does not have a STORED variable.");
+			}
+			throw std::runtime_error("Use of TernaryTree.getGreater() when there is no greater node.");
+		}
+		throw std::runtime_error("Use of TernaryTree.getGreater() when the tree is empty.");
+	}
 
-					nodes.back()->_op=STRING_TO_OP(str_op);
+	/*!
+	*\brief Return the OP variable of the greater node of the node pointed by the cursor.
+	* Throw an std::runetime_error exception if the OP variable does not exist.
+	*\return OP : the OP variable.
+	*/
+	OP getGreaterOp()
+	{
+		if(_cursor!=nullptr)
+		{
+			if(_cursor->_greater!=nullptr)
+				return _cursor->_greater->_op;
+			throw std::runtime_error("Use of TernaryTree.getGreaterOp() when there is no greater node.");
+		}
+		throw std::runtime_error("Use of TernaryTree.getGreaterOp() when the tree is empty.");
+	}
 
-					if(!str_stored.empty())
-					{
-						nodes.back()->_stored=new STORED;
-						(*nodes.back()->_stored)=STRING_TO_STORED(str_stored);
+	/*!
+	*\brief Return the STORED variable of the smaller node of the node pointed by the cursor.
+	* Throw an std::runetime_error exception if the STORED variable does not exist.
+	*\return STORED : the STORED variable.
+	*/
+	STORED getSmaller()
+	{
+		if(_cursor!=nullptr)
+		{
+			if(_cursor->_smaller!=nullptr)
+			{
+				if(_cursor->_smaller->_stored!=nullptr)
+					return (*_cursor->_smaller->_stored);
+				throw std::runtime_error("Use of TernaryTree.getSmaller() when the smaller node does not have a STORED variable.");
+			}
+			throw std::runtime_error("Use of TernaryTree.getSmaller() when there is no smaller node.");
+		}
+		throw std::runtime_error("Use of TernaryTree.getSmaller() when the tree is empty.");
+	}
 
-						#ifndef TERNARYTREE_LIGHT
-						propagateForOptimization(nodes.back(),1);
-						#endif // TERNARYTREE_LIGHT
-					}
+	/*!
+	*\brief Return the OP variable of the smaller node of the node pointed by the cursor.
+	* Throw an std::runetime_error exception if the OP variable does not exist.
+	*\return OP : the OP variable.
+	*/
+	OP getSmallerOp()
+	{
+		if(_cursor!=nullptr)
+		{
+			if(_cursor->_smaller!=nullptr)
+				return _cursor->_smaller->_op;
+			throw std::runtime_error("Use of TernaryTree.getSmallerOp() when there is no smaller node.");
+		}
+		throw std::runtime_error("Use of TernaryTree.getSmallerOp() when the tree is empty.");
+	}
 
-					node_id=0;
-					father_id=0;
-					link_type=0;
-					str_op.clear();
-					str_stored.clear();
-				}
+	/*!
+	*\brief Return the STORED variable of the next node of the node pointed by the cursor.
+	* Throw an std::runetime_error exception if the STORED variable does not exist.
+	*\return STORED : the STORED variable.
+	*/
+	STORED getNext()
+	{
+		if(_cursor!=nullptr)
+		{
+			if(_cursor->_next!=nullptr)
+			{
+				if(_cursor->_next->_stored!=nullptr)
+					return (*_cursor->_next->_stored);
+				throw std::runtime_error("Use of TernaryTree.getNext() when the next node does not have a STORED variable.");
 			}
+			throw std::runtime_error("Use of TernaryTree.getNext() when there is no next node.");
 		}
+		throw std::runtime_error("Use of TernaryTree.getNext() when the tree is empty.");
 	}
 
+	/*!
+	*\brief Return the OP variable of the next node of the node pointed by the cursor.
+	* Throw an std::runetime_error exception if the OP variable does not exist.
+	*\return OP : the OP variable.
+	*/
+	OP getNextOp()
+	{
+		if(_cursor!=nullptr)
+		{
+			if(_cursor->_next!=nullptr)
+				return _cursor->_next->_op;
+			throw std::runtime_error("Use of TernaryTree.getNextOp() when there is no next node.");
+		}
+		throw std::runtime_error("Use of TernaryTree.getNextOp() when the tree is empty.");
+	}
+};
 
+/*!
+*\class PersistentTernaryTree ternarytree.hpp "ternarytree.hpp"
+*\brief A template class to share versions of a ternary tree between readers and a writer.
+* The writer modifies the tree with set and remove, which copy only the nodes on the path of the key
+* (O(depth) new nodes, the other subtrees are shared with the previous versions), and makes its modifications
+* visible with publish, which swaps the root atomically.
+* Readers pin the last published version with a Reader and use it without any lock or reference count,
+* so each lookup is wait-free. The nodes replaced by the writer are reclaimed by epochs,
+* once no Reader pinned a version older than them.
+*/
+template <class OP,class STORED,class COMPARE=TernaryTreeCompare<OP> >
+class PersistentTernaryTree
+{
 public:
 
+	typedef TernaryTree<OP,STORED,COMPARE> Tree;
+	typedef typename Tree::size_type size_type;
+
+private:
+
 	/*!
-	*\brief Default constructor.
+	*\brief Node of a version. A published node is never modified, only replaced by a copy.
 	*/
-	TernaryTree(void) {}
+	struct Node
+	{
+		OP _op;
+		STORED* _stored=nullptr;
+		Node* _smaller=nullptr;
+		Node* _greater=nullptr;
+		Node* _next=nullptr;
+		std::uint64_t _version;
+
+		Node(const OP& op,std::uint64_t version) : _op(op), _version(version) {}
+
+		Node(const Node& node,std::uint64_t version) : _op(node._op), _smaller(node._smaller), _greater(node._greater), _next(node._next), _version(version)
+		{
+			if(node._stored!=nullptr)
+				_stored=new STORED(*node._stored);
+		}
+
+		~Node()
+		{
+			delete _stored;
+		}
+	};
 
 	/*!
-	*\brief Default constructor.
+	*\brief A published version : its root and its sizes.
+	*/
+	struct Version
+	{
+		Node* root;
+		size_type nb_node;
+		size_type nb_stored;
+	};
+
+	/*!
+	*\brief The nodes and the version replaced by a publication, with the epoch from which they are unreachable.
+	*/
+	struct Retired
+	{
+		std::uint64_t epoch;
+		std::vector<Node*> nodes;
+		const Version* version;
+	};
+
+	/*!
+	*\brief The epoch announced by a Reader, 0 when it has no pinned version. Padded to its own cache line.
 	*/
-	TernaryTree(const TernaryTree<OP,STORED> &) {}
+	struct ReaderSlot
+	{
+		std::atomic<std::uint64_t> epoch;
+		std::atomic<bool> taken;
+		char padding[64-sizeof(std::atomic<std::uint64_t>)-sizeof(std::atomic<bool>)];
+	};
+
+	std::atomic<const Version*> _current;
+	std::atomic<std::uint64_t> _epoch;
+	std::unique_ptr<ReaderSlot[]> _slots;
+	unsigned int _nb_slots;
+	COMPARE _compare;
+
+	// writer's state, protected by _writer_mutex
+	std::mutex _writer_mutex;
+	Node* _root=nullptr;
+	size_type _nb_node=0;
+	size_type _nb_stored=0;
+	std::uint64_t _version=1;
+	bool _modified=false;
+	std::vector<Node*> _replaced;
+	std::vector<Retired> _retired;
+
+	/*!
+	*\brief Private static recursive function.
+	* Copy the nodes of a TernaryTree.
+	*\param[in] node const typename Tree::Node* : the root of the subtree to copy.
+	*\return Node* : the root of the copy.
+	*/
+	static Node* copyTree(const typename Tree::Node* node)
+	{
+		if(node==nullptr)
+			return nullptr;
+		Node* copy=new Node(node->_op,0);
+		if(node->_stored!=nullptr)
+			copy->_stored=new STORED(*node->_stored);
+		copy->_smaller=copyTree(node->_smaller);
+		copy->_greater=copyTree(node->_greater);
+		copy->_next=copyTree(node->_next);
+		return copy;
+	}
 
 	/*!
-	*\brief Destructor.
+	*\brief Private static recursive function.
+	* Delete a subtree.
+	*\param[in] node Node* : the root of the subtree.
+	*\return void
 	*/
-	~TernaryTree()
+	static void deleteTree(Node* node)
 	{
-		if(_first!=nullptr)
-			delete _first;
+		if(node==nullptr)
+			return;
+		deleteTree(node->_smaller);
+		deleteTree(node->_greater);
+		deleteTree(node->_next);
+		delete node;
 	}
 
 	/*!
-	*\brief Save the tree in a file.
-	*\param[in] path const std::string& : path to the file where the tree will be saved.
-	*\param[in] OP_TO_STRING std::string(OP) : a function to cast an OP variable into an std::string.
-	*\param[in] STORED_TO_STRING std::string(STORED) : a function to cast a STORED variable into an std::string.
-	*\param[in] reset_cursor bool : set by default to true. If true the fonction will place the cursor to the root of the tree before starting.
-	*\return void
+	*\brief Private function.
+	* Return a node the writer can modify : the node itself if it was created since the last publication,
+	* else a copy of it, the node being reclaimed once no Reader can see it anymore.
+	*\param[in] node Node* : the node.
+	*\return Node* : the node to modify.
 	*/
-	void saveToFile(const std::string& path,std::string OP_TO_STRING(OP),std::string STORED_TO_STRING(STORED),bool reset_cursor=true)
+	Node* writable(Node* node)
 	{
-		if(reset_cursor)
-			resetCursor();
-		std::ofstream output_file(path.c_str());
-		unsigned int n=0;
-		if(output_file)
-		{
-			saveToFile(_cursor,n,0,0,output_file,OP_TO_STRING,STORED_TO_STRING);
-		}
-		output_file.close();
+		if(node->_version==_version)
+			return node;
+		_replaced.push_back(node);
+		return new Node(*node,_version);
 	}
 
 	/*!
-	*\brief Load a tree from a file.
-	*\param[in] path const std::string& : path to the file where the tree is saved.
-	*\param[in] STRING_TO_OP OP(std::string) : a function to cast an std::string  into an OP variable.
-	*\param[in] STRING_TO_STORED STORED(std::string) : a function to cast an std::string  into a STORED variable.
+	*\brief Private function.
+	* Remove a writable node from its level, its smaller and greater subtrees being kept.
+	*\param[in] link Node** : the link to the node, in a writable node or the root.
 	*\return void
 	*/
-	void loadFromFile(const std::string& path,OP STRING_TO_OP(std::string),STORED STRING_TO_STORED(std::string))
+	void unlinkNode(Node** link)
 	{
-		if(_first!=nullptr)
-			delete _first;
-		std::deque<Node*> nodes;
-		std::ifstream input_file(path.c_str());
-		if(input_file)
+		Node* node=*link;
+		if(node->_smaller==nullptr)
+			*link=node->_greater;
+		else if(node->_greater==nullptr)
+			*link=node->_smaller;
+		else
 		{
-			loadFromFile(nodes,input_file,STRING_TO_OP,STRING_TO_STORED);
+			// the smallest node of the greater subtree takes the place of the node
+			Node** smallest=&node->_greater;
+			*smallest=writable(*smallest);
+			while((*smallest)->_smaller!=nullptr)
+			{
+				smallest=&(*smallest)->_smaller;
+				*smallest=writable(*smallest);
+			}
+			Node* replacement=*smallest;
+			*smallest=replacement->_greater;
+			replacement->_smaller=node->_smaller;
+			replacement->_greater=node->_greater;
+			*link=replacement;
 		}
-		input_file.close();
+		delete node;
+		_nb_node--;
 	}
 
-	#ifndef TERNARYTREE_LIGHT
 	/*!
-	*\brief Works from the tree's root.
-	* Optimize the tree's structure to reduce the mean acces time.
+	*\brief Private function.
+	* Delete the retired nodes that no Reader can see anymore.
 	*\return void
 	*/
-	void optimize()
+	void reclaim()
 	{
-		optimize(_first);
+		std::uint64_t oldest=std::numeric_limits<std::uint64_t>::max();
+		for(unsigned int i=0;i<_nb_slots;i++)
+		{
+			std::uint64_t epoch=_slots[i].epoch.load();
+			if(epoch!=0 && epoch<oldest)
+				oldest=epoch;
+		}
+
+		std::size_t nb_kept=0;
+		for(std::size_t i=0;i<_retired.size();i++)
+		{
+			if(_retired[i].epoch<=oldest)
+			{
+				for(Node* node : _retired[i].nodes)
+					delete node;
+				delete _retired[i].version;
+			}
+			else
+				std::swap(_retired[nb_kept++],_retired[i]);
+		}
+		_retired.resize(nb_kept);
 	}
 
+public:
+
 	/*!
-	*\brief Remove the node pointed by the cursor.
-	* Set the cursor to the root of the tree.
-	*\param[in] ops const OP_COL& : the collection of OP
-	*\param[in] reset_cursor bool : set by default to true. If true the fonction will place the cursor to the root of the tree before starting.
-	*\return bool : true if the tree's structure as been modified, false if the collection of OP was not in the tree's structure.
+	*\class Reader
+	*\brief A reader of a PersistentTernaryTree, used by one thread at a time.
+	* pin gives access to the last published version, which stays valid and unchanged until release or the next pin.
+	* A pinned version prevents the reclamation of the nodes replaced after it, so it should not be kept too long.
 	*/
-	void remove()
+	class Reader
 	{
-		if(_cursor!=nullptr)
+		PersistentTernaryTree<OP,STORED,COMPARE>& _tree;
+		ReaderSlot* _slot=nullptr;
+		const Version* _version=nullptr;
+
+	public:
+
+		/*!
+		*\brief Constructor.
+		* Throw an std::runetime_error exception if the tree already has as many readers as its number of reader slots.
+		*\param[in] tree PersistentTernaryTree<OP,STORED,COMPARE>& : the tree to read.
+		*/
+		explicit Reader(PersistentTernaryTree<OP,STORED,COMPARE>& tree) : _tree(tree)
 		{
-			if(_cursor->_next!=nullptr)
+			for(unsigned int i=0;i<_tree._nb_slots && _slot==nullptr;i++)
 			{
-				if(_cursor->_stored!=nullptr)
-				{
-					delete _cursor->_stored;
-					_nb_stored--;
-					propagateForOptimization(_cursor,-1);
-				}
+				bool taken=false;
+				if(_tree._slots[i].taken.compare_exchange_strong(taken,true))
+					_slot=&_tree._slots[i];
 			}
-			else
-			{
-				if(_cursor->_smaller!=nullptr && _cursor->_greater==nullptr)
-				{
-					(*_cursor->_father_link)=_cursor->_smaller;
-				}
-				else if(_cursor->_smaller==nullptr && _cursor->_greater!=nullptr)
-				{
-					(*_cursor->_father_link)=_cursor->_greater;
-				}
-				else if(_cursor->_smaller!=nullptr && _cursor->_greater!=nullptr)
-				{
-					Node* new_father_of_smaller;
+			if(_slot==nullptr)
+				throw std::runtime_error("Use of PersistentTernaryTree::Reader() when all the reader slots are taken.");
+		}
 
-					(*_cursor->_father_link)=_cursor->_greater;
-					new_father_of_smaller=getSmallestLeaf(_cursor->_greater,_cursor->_nb_smaller);
-					new_father_of_smaller->_smaller=_cursor->_smaller;
+		Reader(const Reader&)=delete;
+		Reader& operator=(const Reader&)=delete;
 
-					_cursor->_greater->_father=_cursor->_father;
-					_cursor->_greater->_father_link=_cursor->_father_link;
-					_cursor->_smaller->_father=new_father_of_smaller;
-					_cursor->_smaller->_father_link=(&new_father_of_smaller->_smaller);
-				}
-				else //leaf
-				{
-					(*_cursor->_father_link)=nullptr;
-					Node* cursor_save=_cursor;
-					_cursor=_cursor->_father;
-					while(cursorIsOnALeaf() && _cursor->_stored==nullptr)
-					{
-						(*_cursor->_father_link)=nullptr;
-						_nb_node--;
-						_cursor=_cursor->_father;
-					}
-					_cursor=cursor_save;
-				}
-				_cursor->_greater=nullptr;
-				_cursor->_smaller=nullptr;
-				if(_cursor->_stored!=nullptr)
+		/*!
+		*\brief Destructor, release the pinned version.
+		*/
+		~Reader()
+		{
+			release();
+			_slot->taken.store(false);
+		}
+
+		/*!
+		*\brief Pin the last published version. Wait-free.
+		*\return void
+		*/
+		void pin()
+		{
+			_slot->epoch.store(_tree._epoch.load());
+			_version=_tree._current.load();
+		}
+
+		/*!
+		*\brief Release the pinned version, the pointers given by lookup must not be used anymore.
+		*\return void
+		*/
+		void release()
+		{
+			_version=nullptr;
+			_slot->epoch.store(0,std::memory_order_release);
+		}
+
+		/*!
+		*\brief Return the STORED variable of a range of OP in the pinned version.
+		* Throw an std::runetime_error exception if no version is pinned.
+		*\param[in] begin IT : an iterator on the first OP of the range.
+		*\param[in] end IT : the end iterator of the range.
+		*\return const STORED* : the STORED variable, nullptr if the range of OP does not have one.
+		*/
+		template<class IT>
+		const STORED* lookup(IT begin,IT end) const
+		{
+			if(_version==nullptr)
+				throw std::runtime_error("Use of PersistentTernaryTree::Reader.lookup() when no version is pinned.");
+			const Node* current=_version->root;
+			while(begin!=end && current!=nullptr)
+			{
+				int c=_tree._compare(*begin,current->_op);
+				if(c<0)
+					current=current->_smaller;
+				else if(c>0)
+					current=current->_greater;
+				else
 				{
-					_nb_stored--;
-					propagateForOptimization(_cursor,-1);
+					++begin;
+					if(begin==end)
+						return current->_stored;
+					current=current->_next;
 				}
-				_nb_node--;
-				delete _cursor;
 			}
+			return nullptr;
 		}
-		resetCursor();
-	}
+
+		/*!
+		*\brief Return the STORED variable of a collection of OP in the pinned version.
+		* Throw an std::runetime_error exception if no version is pinned.
+		*\param[in] ops const OP_COL& : the collection of OP.
+		*\return const STORED* : the STORED variable, nullptr if the collection of OP does not have one.
+		*/
+		template<class OP_COL>
+		const STORED* lookup(const OP_COL& ops) const
+		{
+			return lookup(Tree::opsBegin(ops),Tree::opsEnd(ops));
+		}
+
+		/*!
+		*\brief Return the number of nodes of the pinned version.
+		* Throw an std::runetime_error exception if no version is pinned.
+		*\return size_type : the number of nodes.
+		*/
+		size_type getNbNode() const
+		{
+			if(_version==nullptr)
+				throw std::runtime_error("Use of PersistentTernaryTree::Reader.getNbNode() when no version is pinned.");
+			return _version->nb_node;
+		}
+
+		/*!
+		*\brief Return the number of STORED variables of the pinned version.
+		* Throw an std::runetime_error exception if no version is pinned.
+		*\return size_type : the number of STORED variables.
+		*/
+		size_type getNbStored() const
+		{
+			if(_version==nullptr)
+				throw std::runtime_error("Use of PersistentTernaryTree::Reader.getNbStored() when no version is pinned.");
+			return _version->nb_stored;
+		}
+	};
 
 	/*!
-	*\brief Remove a collection of OP to the tree's structure if it s in.
-	* Set the cursor to the root of the tree.
-	*\param[in] ops const OP_COL& : the collection of OP
-	*\param[in] reset_cursor bool : set by default to true. If true the fonction will place the cursor to the root of the tree before starting.
-	*\return bool : true if the tree's structure as been modified, false if the collection of OP was not in the tree's structure.
+	*\brief Default constructor.
+	* The first version is an empty tree.
+	*\param[in] nb_readers unsigned int : set by default to 64. The greatest number of Reader at the same time.
+	*\param[in] compare const COMPARE& : set by default to COMPARE(). The comparator of the OP.
 	*/
-	template<class OP_COL>
-	bool remove(const OP_COL& ops, bool reset_cursor=true)
+	explicit PersistentTernaryTree(unsigned int nb_readers=64,const COMPARE& compare=COMPARE())
+		: _epoch(1), _slots(new ReaderSlot[nb_readers]), _nb_slots(nb_readers), _compare(compare)
 	{
-		if(reset_cursor)
-			resetCursor();
-		typename OP_COL::const_iterator it=ops.begin();
-		if(find(ops,it))
+		for(unsigned int i=0;i<_nb_slots;i++)
 		{
-			remove();
-			return true;
+			_slots[i].epoch.store(0);
+			_slots[i].taken.store(false);
 		}
-		return false;
+		_current.store(new Version{nullptr,0,0});
 	}
-	#endif // TERNARYTREE_OPTIMIZE_UNABLE
 
 	/*!
-	*\brief Delete all the tree's node.
-	*\return void
+	*\brief Constructor from a tree.
+	* The first version is a copy of the tree.
+	*\param[in] tree const Tree& : the tree.
+	*\param[in] nb_readers unsigned int : set by default to 64. The greatest number of Reader at the same time.
 	*/
-	void clear()
+	explicit PersistentTernaryTree(const Tree& tree,unsigned int nb_readers=64)
+		: PersistentTernaryTree(nb_readers,tree._compare)
 	{
-		if(_first!=nullptr)
-			delete _first;
-		_first=nullptr;
-		_cursor=nullptr;
-		_nb_node=0;
-		_nb_stored=0;
+		_root=copyTree(tree._first);
+		_nb_node=tree._nb_node;
+		_nb_stored=tree._nb_stored;
+		_modified=true;
+		publish();
 	}
 
+	PersistentTernaryTree(const PersistentTernaryTree<OP,STORED,COMPARE>&)=delete;
+	PersistentTernaryTree<OP,STORED,COMPARE>& operator=(const PersistentTernaryTree<OP,STORED,COMPARE>&)=delete;
+
 	/*!
-	*\brief Add a collection of OP to the tree's structure if it s not already in.
-	* Set the cursor to the matching node.
-	*\param[in] ops const OP_COL& : the collection of OP
-	*\param[in] reset_cursor bool : set by default to true. If true the fonction will place the cursor to the root of the tree before starting.
-	*\return bool : true if the tree's structure as been modified, false if the collection of OP was already in the tree's structure.
+	*\brief Destructor. No Reader may be left.
 	*/
-	template<class OP_COL>
-	bool add(const OP_COL& ops, bool reset_cursor=true)
+	~PersistentTernaryTree()
 	{
-		if(reset_cursor)
-			resetCursor();
+		for(Node* node : _replaced)
+			delete node;
+		for(unsigned int i=0;i<_nb_slots;i++)
+			_slots[i].epoch.store(0);
+		reclaim();
+		deleteTree(_root);
+		delete _current.load();
+	}
 
-		#ifndef TERNARYTREE_LIGHT
-		find_to_add=true;
-		#endif // TERNARYTREE_LIGHT
+	/*!
+	*\brief Set the STORED variable of a range of OP, the range being added if needed.
+	* The modification is visible to the readers after the next publish.
+	* Throw an std::runetime_error exception if the range is empty.
+	*\param[in] begin IT : an iterator on the first OP of the range.
+	*\param[in] end IT : the end iterator of the range.
+	*\param[in] stored STORED : the STORED variable.
+	*\return bool : true if the range of OP did not have a STORED variable.
+	*/
+	template<class IT>
+	bool set(IT begin,IT end,STORED stored)
+	{
+		if(begin==end)
+			throw std::runtime_error("Use of PersistentTernaryTree.set() with an empty collection of OP.");
 
-		typename OP_COL::const_iterator it=ops.begin();
-		if(!find(ops,it))
+		std::lock_guard<std::mutex> lock(_writer_mutex);
+		Node** link=&_root;
+		Node* current=nullptr;
+		while(begin!=end)
 		{
-			if(_first==nullptr) // add to first (empty tree)
-			{
-				_first=new Node();
-				_nb_node++;
-
-				_cursor=_first;
-				_cursor->_op=*it;
-
-				#ifndef TERNARYTREE_LIGHT
-				_cursor->_father_link=(&_first);
-				#endif // TERNARYTREE_LIGHT
-			}
-			else if(_cursor->_op<*it) //add to greater
+			if(*link==nullptr)
 			{
-				_cursor->_greater=new Node();
+				*link=new Node(*begin,_version);
 				_nb_node++;
-
-				#ifndef TERNARYTREE_LIGHT
-				_cursor->_nb_greater++;
-				_cursor->_greater->_father_nb=(&_cursor->_nb_greater);
-				_cursor->_greater->_father=_cursor;
-				_cursor->_greater->_father_link=(&_cursor->_greater);
-				#endif // TERNARYTREE_LIGHT
-
-				_cursor=_cursor->_greater;
-				_cursor->_op=*it;
 			}
-			else if(_cursor->_op>*it) // add to smaller
-			{
-				_cursor->_smaller=new Node();
-				_nb_node++;
-
-				#ifndef TERNARYTREE_LIGHT
-				_cursor->_nb_smaller++;
-				_cursor->_smaller->_father_nb=(&_cursor->_nb_smaller);
-				_cursor->_smaller->_father=_cursor;
-				_cursor->_smaller->_father_link=(&_cursor->_smaller);
-				#endif // TERNARYTREE_LIGHT
+			else
+				*link=writable(*link);
+			current=*link;
 
-				_cursor=_cursor->_smaller;
-				_cursor->_op=*it;
-			}
-			while(it+1!=ops.end())
+			int c=_compare(*begin,current->_op);
+			if(c<0)
+				link=&current->_smaller;
+			else if(c>0)
+				link=&current->_greater;
+			else
 			{
-				_cursor->_next=new Node();
-				_nb_node++;
-
-				#ifndef TERNARYTREE_LIGHT
-				_cursor->_nb_next++;
-				_cursor->_next->_father_nb=(&_cursor->_nb_next);
-				_cursor->_next->_father=_cursor;
-				_cursor->_next->_father_link=(&_cursor->_next);
-				#endif // TERNARYTREE_LIGHT
-
-				it++;
-				_cursor=_cursor->_next;
-				_cursor->_op=*it;
+				link=&current->_next;
+				++begin;
 			}
-
-			#ifndef TERNARYTREE_LIGHT
-			find_to_add=false;
-			#endif // TERNARYTREE_LIGHT
-
-			return true;
 		}
 
-		#ifndef TERNARYTREE_LIGHT
-		find_to_add=false;
-		#endif // TERNARYTREE_LIGHT
-
-		return false;
-	}
-
-	/*!
-	*\brief Set the STORED variable of the node pointed by the cursor.
-	* Throw an std::runetime_error exception if the tree is empty.
-	*\param[in] stored STORED : the STORED variable.
-	*\return void
-	*/
-	void set(STORED stored)
-	{
-		if(_cursor==nullptr)
-			throw std::runtime_error("Use of TernaryTree.set(const STORED& stored) when the tree is empty.");
-		if(_cursor->_stored==nullptr)
+		_modified=true;
+		if(current->_stored==nullptr)
 		{
-			_cursor->_stored=new STORED;
+			current->_stored=new STORED(stored);
 			_nb_stored++;
+			return true;
 		}
-		(*_cursor->_stored)=stored;
+		*current->_stored=stored;
+		return false;
 	}
 
 	/*!
-	*\brief Add a collection of OP to the tree's structure if it s not already in.
-	* Set the cursor to the matching node.
-	* Set the STORED variable of the node pointed by the cursor
-	*\param[in] ops const OP_COL& : the collection of OP
-	*\param[in] stored STORED : the STORED variable
-	*\param[in] reset_cursor bool : set by default to true. If true the fonction will place the cursor to the root of the tree before starting.
-	*\return bool : true if the tree's structure as been modified, false if the collection of OP was already in the tree's structure.
+	*\brief Set the STORED variable of a collection of OP, the collection being added if needed.
+	* The modification is visible to the readers after the next publish.
+	* Throw an std::runetime_error exception if the collection is empty.
+	*\param[in] ops const OP_COL& : the collection of OP.
+	*\param[in] stored STORED : the STORED variable.
+	*\return bool : true if the collection of OP did not have a STORED variable.
 	*/
 	template<class OP_COL>
-	bool add(const OP_COL& ops,STORED stored, bool reset_cursor=true)
+	bool set(const OP_COL& ops,STORED stored)
 	{
-		bool r_bool=add(ops,reset_cursor);
-		set(stored);
-		return r_bool;
+		return set(Tree::opsBegin(ops),Tree::opsEnd(ops),stored);
 	}
 
 	/*!
-	*\brief Set the cursor to the root of the tree.
-	*\return void
+	*\brief Remove the STORED variable of a range of OP, and the nodes which are not used anymore.
+	* The modification is visible to the readers after the next publish.
+	*\param[in] begin IT : an iterator on the first OP of the range.
+	*\param[in] end IT : the end iterator of the range.
+	*\return bool : true if the range of OP had a STORED variable.
 	*/
-	void resetCursor()
+	template<class IT>
+	bool remove(IT begin,IT end)
 	{
-		_cursor=_first;
-	}
+		std::lock_guard<std::mutex> lock(_writer_mutex);
 
-	/*!
-	*\brief Test if a collection of OP is in the tree's structure.
-	* Set the cursor to the best matching node.
-	*\param[in] ops const OP_COL& : the collection of OP
-	*\param[in] reset_cursor bool : set by default to true. If true the fonction will place the cursor to the root of the tree before starting.
-	*\return bool : true if the collection of OP is in the tree's structure, false if not.
-	*/
-	template<class OP_COL>
-	bool find(const OP_COL& ops, bool reset_cursor=true)
-	{
-		if(reset_cursor)
-			resetCursor();
-		typename OP_COL::const_iterator it=ops.begin();
-		return find(ops,it);
+		// find the key without copying anything, the path is kept as the links to follow
+		std::vector<int> path;
+		const Node* current=_root;
+		while(begin!=end && current!=nullptr)
+		{
+			int c=_compare(*begin,current->_op);
+			if(c<0)
+			{
+				path.push_back(0);
+				current=current->_smaller;
+			}
+			else if(c>0)
+			{
+				path.push_back(1);
+				current=current->_greater;
+			}
+			else
+			{
+				++begin;
+				if(begin==end)
+					break;
+				path.push_back(2);
+				current=current->_next;
+			}
+		}
+		if(current==nullptr || begin!=end || current->_stored==nullptr)
+			return false;
+
+		// copy the path, keeping the link to the matching node of each level
+		std::vector<Node**> levels;
+		Node** link=&_root;
+		levels.push_back(link);
+		for(int direction : path)
+		{
+			*link=writable(*link);
+			if(direction==0)
+				link=&(*link)->_smaller;
+			else if(direction==1)
+				link=&(*link)->_greater;
+			else
+			{
+				link=&(*link)->_next;
+				levels.push_back(link);
+				continue;
+			}
+			levels.back()=link;
+		}
+		*link=writable(*link);
+
+		delete (*link)->_stored;
+		(*link)->_stored=nullptr;
+		_nb_stored--;
+		_modified=true;
+
+		// remove the nodes which have neither a STORED variable nor a next level
+		for(std::size_t i=levels.size();i>0;i--)
+		{
+			Node* node=*levels[i-1];
+			if(node->_stored!=nullptr || node->_next!=nullptr)
+				break;
+			unlinkNode(levels[i-1]);
+		}
+		return true;
 	}
 
 	/*!
-	*\brief Works from the subtree pointed by the cursor.
-	* Put the cursor to the greater node if it exist.
-	*\return bool : true if the cursor has been modify, false if not.
+	*\brief Remove the STORED variable of a collection of OP, and the nodes which are not used anymore.
+	* The modification is visible to the readers after the next publish.
+	*\param[in] ops const OP_COL& : the collection of OP.
+	*\return bool : true if the collection of OP had a STORED variable.
 	*/
-	bool moveToGreater()
+	template<class OP_COL>
+	bool remove(const OP_COL& ops)
 	{
-		if(_cursor==nullptr || _cursor->_greater==nullptr)
-			return false;
-		_cursor=_cursor->_greater;
-		return true;
+		return remove(Tree::opsBegin(ops),Tree::opsEnd(ops));
 	}
 
 	/*!
-	*\brief Works from the subtree pointed by the cursor.
-	* Put the cursor to the smaller node if it exist.
-	*\return bool : true if the cursor has been modify, false if not.
+	*\brief Make the modifications done since the last publication visible to the readers, atomically.
+	* The nodes replaced by those modifications are deleted once no Reader can see them anymore.
+	*\return void
 	*/
-	bool moveToSmaller()
+	void publish()
 	{
-		if(_cursor==nullptr || _cursor->_smaller==nullptr)
-			return false;
-		_cursor=_cursor->_smaller;
-		return true;
+		std::lock_guard<std::mutex> lock(_writer_mutex);
+		if(_modified)
+		{
+			const Version* previous=_current.exchange(new Version{_root,_nb_node,_nb_stored});
+			_retired.push_back(Retired{_epoch.fetch_add(1)+1,std::move(_replaced),previous});
+			_replaced.clear();
+			_version++;
+			_modified=false;
+		}
+		reclaim();
 	}
+};
+
+/*!
+*\class ShardedTernaryTree ternarytree.hpp "ternarytree.hpp"
+*\brief A template class to share a dictionary between several writers.
+* The keys are partitioned into independent TernaryTree shards by the hash of their first OP,
+* each shard having its own lock, so writers only wait for the ones working on the same shard.
+* HASH is the hash function of the OP type.
+*/
+template <class OP,class STORED,class COMPARE=TernaryTreeCompare<OP>,class HASH=std::hash<OP> >
+class ShardedTernaryTree
+{
+public:
+
+	typedef TernaryTree<OP,STORED,COMPARE> Tree;
+	typedef typename Tree::size_type size_type;
+
+private:
 
 	/*!
-	*\brief Works from the subtree pointed by the cursor.
-	* Put the cursor to the next node if it exist.
-	*\return bool : true if the cursor has been modify, false if not.
+	*\class Shard ternarytree.hpp "ternarytree.hpp"
+	*\brief A private class of ShardedTernaryTree to handle each shard
 	*/
-	bool moveToNext()
+	class Shard
 	{
-		if(_cursor==nullptr || _cursor->_next==nullptr)
-			return false;
-		_cursor=_cursor->_next;
-		return true;
-	}
+	public:
+		Tree _tree;
+		std::mutex _mutex;
+
+		explicit Shard(const COMPARE& compare) : _tree(compare) {}
+	};
+
+	std::vector<std::unique_ptr<Shard> > _shards;
+
+	COMPARE _compare;
+	HASH _hash;
 
 	/*!
-	*\brief Works from the subtree pointed by the cursor.
-	* Test if the node has a STORED variable.
-	*\return bool : true if the greater node exist, false if not.
+	*\brief Private function.
+	* Return the shard of a range of OP.
+	*\param[in] begin IT : an iterator on the first OP of the range.
+	*\param[in] end IT : the end iterator of the range.
+	*\return Shard& : the shard, the first one if the range is empty.
 	*/
-	bool hasAStored()
+	template<class IT>
+	Shard& shardOf(IT begin,IT end) const
 	{
-		return !(_cursor->_stored==nullptr);
+		if(begin==end)
+			return *_shards[0];
+		return *_shards[_hash(*begin)%_shards.size()];
 	}
 
+public:
+
 	/*!
-	*\brief Test if the cursor point to a leaf.
-	*\return bool : true if the cursor point to a leaf, false if not.
+	*\brief Constructor.
+	*\param[in] nb_shards unsigned int : the number of shards, set by default to 16.
+	*\param[in] compare const COMPARE& : the three-way comparator used to sort the OP variables.
+	*\param[in] hash const HASH& : the hash function used to choose the shard of a key.
 	*/
-	bool cursorIsOnALeaf()
+	explicit ShardedTernaryTree(unsigned int nb_shards=16,const COMPARE& compare=COMPARE(),const HASH& hash=HASH()) : _compare(compare), _hash(hash)
 	{
-		if(_cursor!=nullptr)
-			return _cursor->_greater==nullptr && _cursor->_smaller==nullptr && _cursor->_next==nullptr;
-		return false;
+		if(nb_shards==0)
+			nb_shards=1;
+		for(unsigned int i=0;i<nb_shards;i++)
+			_shards.push_back(std::unique_ptr<Shard>(new Shard(compare)));
 	}
 
+	ShardedTernaryTree(const ShardedTernaryTree<OP,STORED,COMPARE,HASH>&)=delete;
+	ShardedTernaryTree<OP,STORED,COMPARE,HASH>& operator=(const ShardedTernaryTree<OP,STORED,COMPARE,HASH>&)=delete;
+
 	/*!
-	*\brief Works from the root of the tree.
-	* Test if the tree is empty.
-	*\return bool : true if the tree is empty, false if not.
+	*\brief Add a collection of OP to the structure if it s not already in.
+	* Throw an std::runetime_error exception if the collection is empty.
+	*\param[in] ops const OP_COL& : the collection of OP
+	*\return bool : true if the structure as been modified, false if the collection of OP was already in the structure.
 	*/
-	bool isEmpty()
+	template<class OP_COL>
+	bool add(const OP_COL& ops)
 	{
-		return _first==nullptr;
+		Shard& shard=shardOf(std::begin(ops),std::end(ops));
+		std::lock_guard<std::mutex> lock(shard._mutex);
+		return shard._tree.add(ops);
 	}
 
 	/*!
-	*\brief Works from the subtree pointed by the cursor.
-	* Test if the greater node exist.
-	*\return bool : true if the greater node exist, false if not.
+	*\brief Add a collection of OP to the structure if it s not already in and set its STORED variable.
+	* Throw an std::runetime_error exception if the collection is empty.
+	*\param[in] ops const OP_COL& : the collection of OP
+	*\param[in] stored STORED : the STORED variable
+	*\return bool : true if the structure as been modified, false if the collection of OP was already in the structure.
 	*/
-	bool greaterExist()
+	template<class OP_COL>
+	bool add(const OP_COL& ops,STORED stored)
 	{
-		return !_cursor->_greater==nullptr;
+		Shard& shard=shardOf(std::begin(ops),std::end(ops));
+		std::lock_guard<std::mutex> lock(shard._mutex);
+		return shard._tree.add(ops,stored);
 	}
 
 	/*!
-	*\brief Works from the subtree pointed by the cursor.
-	* Test if the next node exist.
-	*\return bool : true if the smaller node exist, false if not.
+	*\brief Set the STORED variable of a collection of OP if it is in the structure.
+	*\param[in] ops const OP_COL& : the collection of OP
+	*\param[in] stored STORED : the STORED variable
+	*\return bool : true if the STORED variable has been set, false if the collection of OP is not in the structure.
 	*/
-	bool smallerExist()
+	template<class OP_COL>
+	bool set(const OP_COL& ops,STORED stored)
 	{
-		return !_cursor->_smaller==nullptr;
+		Shard& shard=shardOf(std::begin(ops),std::end(ops));
+		std::lock_guard<std::mutex> lock(shard._mutex);
+		if(!shard._tree.find(ops))
+			return false;
+		shard._tree.set(stored);
+		return true;
 	}
 
 	/*!
-	*\brief Works from the subtree pointed by the cursor.
-	* Test if the greater node exist.
-	*\return bool : true if the next node exist, false if not.
+	*\brief Test if a collection of OP is in the structure.
+	*\param[in] ops const OP_COL& : the collection of OP
+	*\return bool : true if the collection of OP is in the structure, false if not.
 	*/
-	bool nextExist()
+	template<class OP_COL>
+	bool find(const OP_COL& ops)
 	{
-		return !_cursor->_next==nullptr;
+		Shard& shard=shardOf(std::begin(ops),std::end(ops));
+		std::lock_guard<std::mutex> lock(shard._mutex);
+		return shard._tree.find(ops);
 	}
 
 	/*!
-	*\brief Return the tree's number of node.
-	*\return unsigned int : the number of node.
+	*\brief Copy the STORED variable of a collection of OP.
+	*\param[in] ops const OP_COL& : the collection of OP
+	*\param[out] stored STORED& : the STORED variable, unchanged if the collection of OP does not have one.
+	*\return bool : true if the collection of OP has a STORED variable, false if not.
 	*/
-	unsigned int getNbNode()
+	template<class OP_COL>
+	bool find(const OP_COL& ops,STORED& stored)
 	{
-		return _nb_node;
+		Shard& shard=shardOf(std::begin(ops),std::end(ops));
+		std::lock_guard<std::mutex> lock(shard._mutex);
+		const STORED* found=shard._tree.lookup(ops);
+		if(found==nullptr)
+			return false;
+		stored=*found;
+		return true;
 	}
 
+	#ifndef TERNARYTREE_LIGHT
 	/*!
-	*\brief Return the number of STORED variable in the tree.
-	*\return unsigned int : the number of STORED variable.
+	*\brief Remove a collection of OP from the structure if it s in.
+	*\param[in] ops const OP_COL& : the collection of OP
+	*\return bool : true if the structure as been modified, false if the collection of OP was not in the structure.
 	*/
-	unsigned int getNbStored()
+	template<class OP_COL>
+	bool remove(const OP_COL& ops)
 	{
-		return _nb_stored;
+		Shard& shard=shardOf(std::begin(ops),std::end(ops));
+		std::lock_guard<std::mutex> lock(shard._mutex);
+		return shard._tree.remove(ops);
 	}
 
 	/*!
-	*\brief Return the STORED variable of the node pointed by the cursor.
-	* Throw an std::runetime_error exception if the STORED variable does not exist.
-	*\return STORED : the STORED variable.
+	*\brief Call a function for each key of all the shards, in increasing order.
+	* All the shards are locked during the iteration. Two shards never have a key with the same first OP,
+	* so the sorted keys of each shard are merged by comparing their first OP only.
+	* The keys are read by batches of batch_size keys per shard.
+	*\param[in] callback FUNC : a function called as callback(const std::vector<OP>& key,const STORED& stored).
+	*\param[in] batch_size size_type : set by default to 256.
+	*\return void
 	*/
-	STORED get()
+	template<class FUNC>
+	void forEach(FUNC callback,size_type batch_size=256)
 	{
-		if(_cursor!=nullptr)
+		typedef std::vector<std::pair<std::vector<OP>,STORED> > Batch;
+
+		std::vector<std::unique_lock<std::mutex> > locks;
+		std::vector<Batch> batches(_shards.size());
+		std::vector<size_type> positions(_shards.size(),0);
+		std::vector<size_type> ranks(_shards.size(),0);
+
+		if(batch_size==0)
+			batch_size=1;
+
+		for(unsigned int i=0;i<_shards.size();i++)
+			locks.push_back(std::unique_lock<std::mutex>(_shards[i]->_mutex));
+
+		// load the next batch of a shard, return false if the shard has no more keys
+		auto load=[&](unsigned int i) -> bool
 		{
-			if(_cursor->_stored!=nullptr)
-				return (*_cursor->_stored);
-			throw std::runtime_error("Use of TernaryTree.get() when the node does not have a STORED variable.");
+			batches[i].clear();
+			positions[i]=0;
+			_shards[i]->_tree.selectRange(ranks[i],batch_size,[&](const std::vector<OP>& key,const STORED& stored)
+			{
+				batches[i].push_back(std::make_pair(key,stored));
+			});
+			ranks[i]+=batches[i].size();
+			return !batches[i].empty();
+		};
+
+		// the smallest first OP on top
+		auto greater=[&](unsigned int a,unsigned int b) -> bool
+		{
+			return _compare(batches[a][positions[a]].first[0],batches[b][positions[b]].first[0])>0;
+		};
+		std::priority_queue<unsigned int,std::vector<unsigned int>,decltype(greater)> heads(greater);
+
+		for(unsigned int i=0;i<_shards.size();i++)
+		{
+			if(load(i))
+				heads.push(i);
+		}
+
+		while(!heads.empty())
+		{
+			unsigned int i=heads.top();
+			heads.pop();
+
+			const std::pair<std::vector<OP>,STORED>& item=batches[i][positions[i]];
+			callback(item.first,item.second);
+
+			positions[i]++;
+			if(positions[i]<batches[i].size() || load(i))
+				heads.push(i);
 		}
-		throw std::runtime_error("Use of TernaryTree.get() when the tree is empty.");
 	}
+	#endif // TERNARYTREE_LIGHT
 
 	/*!
-	*\brief Return the OP variable of the node pointed by the cursor.
-	* Throw an std::runetime_error exception if the OP variable does not exist.
-	*\return OP : the OP variable.
+	*\brief Return the number of STORED variables in all the shards.
+	*\return size_type : the number of STORED variables.
 	*/
-	OP getOp()
+	size_type getNbStored()
 	{
-		if(_cursor!=nullptr)
-			return _cursor->_op;
-		throw std::runtime_error("Use of TernaryTree.getOp() when the tree is empty.");
+		size_type nb=0;
+		for(unsigned int i=0;i<_shards.size();i++)
+		{
+			std::lock_guard<std::mutex> lock(_shards[i]->_mutex);
+			nb+=_shards[i]->_tree.getNbStored();
+		}
+		return nb;
 	}
 
 	/*!
-	*\brief Return the STORED variable of the node at the root.
-	* Throw an std::runetime_error exception if the STORED variable does not exist.
-	*\return STORED : the STORED variable.
+	*\brief Return the number of nodes in all the shards.
+	*\return size_type : the number of nodes.
 	*/
-	STORED getFirst()
+	size_type getNbNode()
 	{
-		if(_first!=nullptr)
+		size_type nb=0;
+		for(unsigned int i=0;i<_shards.size();i++)
 		{
-			if(_first->_stored!=nullptr)
-				return (*_first->_stored);
-			throw std::runtime_error("Use of TernaryTree.getFirst() when the root does not have a STORED variable.");
+			std::lock_guard<std::mutex> lock(_shards[i]->_mutex);
+			nb+=_shards[i]->_tree.getNbNode();
 		}
-		throw std::runtime_error("Use of TernaryTree.getFirst() when the tree is empty.");
+		return nb;
 	}
 
 	/*!
-	*\brief Return the OP variable of the node at the root.
-	* Throw an std::runetime_error exception if the OP variable does not exist.
-	*\return OP : the OP variable.
+	*\brief Return the number of shards.
+	*\return unsigned int : the number of shards.
 	*/
-	OP getFirstOp()
+	unsigned int getNbShards() const
 	{
-		if(_first!=nullptr)
-			return _first->_op;
-		throw std::runtime_error("Use of TernaryTree.getFirstOp() when the tree is empty.");
+		return static_cast<unsigned int>(_shards.size());
 	}
+};
+
+/*!
+*\class StaticTernaryTree ternarytree.hpp "ternarytree.hpp"
+*\brief A read-only and compact version of a TernaryTree.
+* The nodes are numbered in breadth-first order, each node having 3 bits telling whether it has a smaller, a greater and a next node.
+* The children are numbered in the order of those bits, so the number of a child is the number of 1 before its bit plus one.
+* The OP variables are kept in an array, and the STORED variables in another one, in the order of the nodes having them.
+* A node takes the size of an OP and about 5 bits, the tree can not be modified.
+*/
+template <class OP,class STORED,class COMPARE=TernaryTreeCompare<OP> >
+class StaticTernaryTree
+{
+public:
+
+	typedef typename TernaryTree<OP,STORED,COMPARE>::size_type size_type;
+
+private:
+
+	typedef typename TernaryTree<OP,STORED,COMPARE>::Node Node;
+
+	// for each node : a smaller node, a greater node, a next node
+	TernaryTreeBitVector _children;
+	// for each node : a STORED variable
+	TernaryTreeBitVector _stored_bits;
+	std::vector<OP> _ops;
+	std::vector<STORED> _stored;
+	COMPARE _compare;
 
 	/*!
-	*\brief Return the STORED variable of the greater node of the node pointed by the cursor.
-	* Throw an std::runetime_error exception if the STORED variable does not exist.
-	*\return STORED : the STORED variable.
+	*\brief Private function.
+	* Return the node linked by a bit, or the number of nodes if there is not.
+	*\param[in] bit std::uint64_t : the position of the bit in _children.
+	*\return std::uint64_t : the number of the node.
 	*/
-	STORED getGreater()
+	std::uint64_t child(std::uint64_t bit) const
 	{
-		if(_cursor!=nullptr)
-		{
-			if(_cursor->_greater!=nullptr)
-			{
-				if(_cursor->_greater->_stored!=nullptr)
-					return (*_cursor->_greater->_stored);
-				throw std::runtime_error("Use of TernaryTree.getGreater() when the greater node does not have a STORED variable.");
-			}
-			throw std::runtime_error("Use of TernaryTree.getGreater() when there is no greater node.");
-		}
-		throw std::runtime_error("Use of TernaryTree.getGreater() when the tree is empty.");
+		if(!_children.get(bit))
+			return _ops.size();
+		return _children.rank(bit)+1;
 	}
 
+public:
+
 	/*!
-	*\brief Return the OP variable of the greater node of the node pointed by the cursor.
-	* Throw an std::runetime_error exception if the OP variable does not exist.
-	*\return OP : the OP variable.
+	*\brief Constructor from a tree.
+	* The tree is not modified, its nodes are read in breadth-first order.
+	*\param[in] tree const TernaryTree<OP,STORED,COMPARE>& : the tree.
 	*/
-	OP getGreaterOp()
+	explicit StaticTernaryTree(const TernaryTree<OP,STORED,COMPARE>& tree) : _compare(tree._compare)
 	{
-		if(_cursor!=nullptr)
+		_ops.reserve(tree.getNbNode());
+		_stored.reserve(tree.getNbStored());
+
+		std::queue<const Node*> nodes;
+		if(tree._first!=nullptr)
+			nodes.push(tree._first);
+		while(!nodes.empty())
 		{
-			if(_cursor->_greater!=nullptr)
-				return _cursor->_greater->_op;
-			throw std::runtime_error("Use of TernaryTree.getGreaterOp() when there is no greater node.");
+			const Node* current=nodes.front();
+			nodes.pop();
+
+			_ops.push_back(current->_op);
+			_stored_bits.pushBack(current->_stored!=nullptr);
+			if(current->_stored!=nullptr)
+				_stored.push_back(*current->_stored);
+
+			const Node* children[3]={current->_smaller,current->_greater,current->_next};
+			for(unsigned int i=0;i<3;i++)
+			{
+				_children.pushBack(children[i]!=nullptr);
+				if(children[i]!=nullptr)
+					nodes.push(children[i]);
+			}
 		}
-		throw std::runtime_error("Use of TernaryTree.getGreaterOp() when the tree is empty.");
+		_children.build();
+		_stored_bits.build();
 	}
 
 	/*!
-	*\brief Return the STORED variable of the smaller node of the node pointed by the cursor.
-	* Throw an std::runetime_error exception if the STORED variable does not exist.
-	*\return STORED : the STORED variable.
+	*\brief Return the STORED variable of a range of OP.
+	* Can be used by several threads at the same time.
+	*\param[in] begin IT : an iterator on the first OP of the range.
+	*\param[in] end IT : the end iterator of the range.
+	*\return const STORED* : the STORED variable, nullptr if the range of OP does not have one.
 	*/
-	STORED getSmaller()
+	template<class IT>
+	const STORED* lookup(IT begin,IT end) const
 	{
-		if(_cursor!=nullptr)
+		const std::uint64_t nb_node=_ops.size();
+		std::uint64_t current=0;
+		while(begin!=end && current<nb_node)
 		{
-			if(_cursor->_smaller!=nullptr)
+			int c=_compare(*begin,_ops[static_cast<std::size_t>(current)]);
+			if(c<0)
+				current=child(3*current);
+			else if(c>0)
+				current=child(3*current+1);
+			else
 			{
-				if(_cursor->_smaller->_stored!=nullptr)
-					return (*_cursor->_smaller->_stored);
-				throw std::runtime_error("Use of TernaryTree.getSmaller() when the smaller node does not have a STORED variable.");
+				++begin;
+				if(begin==end)
+				{
+					if(!_stored_bits.get(current))
+						return nullptr;
+					return &_stored[static_cast<std::size_t>(_stored_bits.rank(current))];
+				}
+				current=child(3*current+2);
 			}
-			throw std::runtime_error("Use of TernaryTree.getSmaller() when there is no smaller node.");
 		}
-		throw std::runtime_error("Use of TernaryTree.getSmaller() when the tree is empty.");
+		return nullptr;
 	}
 
 	/*!
-	*\brief Return the OP variable of the smaller node of the node pointed by the cursor.
-	* Throw an std::runetime_error exception if the OP variable does not exist.
-	*\return OP : the OP variable.
+	*\brief Return the STORED variable of a collection of OP.
+	* Can be used by several threads at the same time.
+	*\param[in] ops const OP_COL& : the collection of OP.
+	*\return const STORED* : the STORED variable, nullptr if the collection of OP does not have one.
 	*/
-	OP getSmallerOp()
+	template<class OP_COL>
+	const STORED* lookup(const OP_COL& ops) const
 	{
-		if(_cursor!=nullptr)
-		{
-			if(_cursor->_smaller!=nullptr)
-				return _cursor->_smaller->_op;
-			throw std::runtime_error("Use of TernaryTree.getSmallerOp() when there is no smaller node.");
-		}
-		throw std::runtime_error("Use of TernaryTree.getSmallerOp() when the tree is empty.");
+		return lookup(TernaryTree<OP,STORED,COMPARE>::opsBegin(ops),TernaryTree<OP,STORED,COMPARE>::opsEnd(ops));
 	}
 
 	/*!
-	*\brief Return the STORED variable of the next node of the node pointed by the cursor.
-	* Throw an std::runetime_error exception if the STORED variable does not exist.
-	*\return STORED : the STORED variable.
+	*\brief Test if the tree is empty.
+	*\return bool : true if the tree is empty, else false.
 	*/
-	STORED getNext()
+	bool isEmpty() const
 	{
-		if(_cursor!=nullptr)
-		{
-			if(_cursor->_next!=nullptr)
-			{
-				if(_cursor->_next->_stored!=nullptr)
-					return (*_cursor->_next->_stored);
-				throw std::runtime_error("Use of TernaryTree.getNext() when the next node does not have a STORED variable.");
-			}
-			throw std::runtime_error("Use of TernaryTree.getNext() when there is no next node.");
-		}
-		throw std::runtime_error("Use of TernaryTree.getNext() when the tree is empty.");
+		return _ops.empty();
 	}
 
 	/*!
-	*\brief Return the OP variable of the next node of the node pointed by the cursor.
-	* Throw an std::runetime_error exception if the OP variable does not exist.
-	*\return OP : the OP variable.
+	*\brief Return the number of nodes.
+	*\return size_type : the number of nodes.
 	*/
-	OP getNextOp()
+	size_type getNbNode() const
 	{
-		if(_cursor!=nullptr)
-		{
-			if(_cursor->_next!=nullptr)
-				return _cursor->_next->_op;
-			throw std::runtime_error("Use of TernaryTree.getNextOp() when there is no next node.");
-		}
-		throw std::runtime_error("Use of TernaryTree.getNextOp() when the tree is empty.");
+		return static_cast<size_type>(_ops.size());
+	}
+
+	/*!
+	*\brief Return the number of STORED variables.
+	*\return size_type : the number of STORED variables.
+	*/
+	size_type getNbStored() const
+	{
+		return static_cast<size_type>(_stored.size());
+	}
+
+	/*!
+	*\brief Return the memory used by the structure of the tree and the OP variables, without the STORED variables.
+	*\return std::size_t : the number of bytes.
+	*/
+	std::size_t memoryUsage() const
+	{
+		return _children.memoryUsage()+_stored_bits.memoryUsage()+_ops.capacity()*sizeof(OP);
 	}
 };
 
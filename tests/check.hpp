@@ -0,0 +1,49 @@
+// Copyright (C) 2020 Quentin Putaud
+// Distributed under the GNU General Public License version 3
+// (http://www.gnu.org/licenses)
+
+#ifndef TERNARYTREE_TESTS_CHECK_HPP
+#define TERNARYTREE_TESTS_CHECK_HPP
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+/*!
+*\brief Stop the test with the failing condition and its line, even when NDEBUG is defined.
+*/
+#define CHECK(condition) \
+	do \
+	{ \
+		if(!(condition)) \
+		{ \
+			std::cerr<<__FILE__<<":"<<__LINE__<<": CHECK("<<#condition<<") failed"<<std::endl; \
+			std::abort(); \
+		} \
+	}while(false)
+
+/*!
+*\brief Conversion functions given to the save and load functions of the tests.
+*/
+inline std::string opToString(char op)
+{
+	return std::string(1,op);
+}
+
+inline char stringToOp(std::string str)
+{
+	CHECK(str.size()==1);
+	return str[0];
+}
+
+inline std::string intToString(int stored)
+{
+	return std::to_string(stored);
+}
+
+inline int stringToInt(std::string str)
+{
+	return std::stoi(str);
+}
+
+#endif // TERNARYTREE_TESTS_CHECK_HPP
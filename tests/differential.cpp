@@ -0,0 +1,417 @@
+// Copyright (C) 2020 Quentin Putaud
+// Distributed under the GNU General Public License version 3
+// (http://www.gnu.org/licenses)
+
+// Randomized differential test : every operation is applied to a TernaryTree and to an std::map,
+// and both are compared after each step. Built once per configuration (default, TERNARYTREE_LIGHT,
+// TERNARYTREE_LARGE, TERNARYTREE_SCORED, TERNARYTREE_PROFILE).
+// Usage : differential [seed] [number of operations]
+
+#include "ternarytree.hpp"
+#include "check.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+typedef TernaryTree<char,int> Tree;
+typedef std::map<std::string,int> Model;
+
+namespace
+{
+
+std::string file_prefix;
+
+std::string randomKey(std::mt19937& random)
+{
+	// a small alphabet, so that keys share prefixes and collide often
+	std::string key;
+	std::size_t length=1+random()%6;
+	for(std::size_t i=0;i<length;i++)
+		key+=static_cast<char>('a'+random()%5);
+	return key;
+}
+
+#ifdef TERNARYTREE_SCORED
+double score(const int& stored)
+{
+	return static_cast<double>(stored%97);
+}
+
+void checkTopK(const Tree& tree,const Model& model,const std::string& prefix,Tree::size_type k)
+{
+	std::vector<double> expected;
+	for(Model::const_iterator it=model.lower_bound(prefix);it!=model.end() && it->first.compare(0,prefix.size(),prefix)==0;++it)
+		expected.push_back(score(it->second));
+	std::sort(expected.begin(),expected.end(),std::greater<double>());
+	if(expected.size()>k)
+		expected.resize(static_cast<std::size_t>(k));
+
+	std::vector<double> found;
+	tree.topK(prefix.begin(),prefix.end(),k,[&](const std::vector<char>& key,const int& stored)
+	{
+		std::string str(key.begin(),key.end());
+		CHECK(str.compare(0,prefix.size(),prefix)==0);
+		Model::const_iterator it=model.find(str);
+		CHECK(it!=model.end() && it->second==stored);
+		found.push_back(score(stored));
+	});
+	CHECK(found==expected);
+}
+#endif // TERNARYTREE_SCORED
+
+void checkTree(const Tree& tree,const Model& model,std::mt19937& random)
+{
+	CHECK(tree.checkIntegrity());
+	CHECK(tree.getNbStored()==model.size());
+	CHECK(tree.isEmpty()==model.empty());
+	for(Model::const_iterator it=model.begin();it!=model.end();++it)
+	{
+		const int* stored=tree.lookup(it->first);
+		CHECK(stored!=nullptr && *stored==it->second);
+	}
+	for(int i=0;i<20;i++)
+	{
+		std::string key=randomKey(random);
+		CHECK((tree.lookup(key)!=nullptr)==(model.count(key)==1));
+	}
+
+	#ifndef TERNARYTREE_LIGHT
+	// the keys come in the order of the map, with their ranks
+	Model::const_iterator expected=model.begin();
+	Tree::size_type rank=0;
+	tree.selectRange(0,tree.getNbStored(),[&](const std::vector<char>& key,const int& stored)
+	{
+		CHECK(expected!=model.end());
+		CHECK(std::string(key.begin(),key.end())==expected->first && stored==expected->second);
+		CHECK(tree.rank(expected->first)==rank);
+		++expected;
+		++rank;
+	});
+	CHECK(expected==model.end());
+
+	std::string lo=randomKey(random);
+	std::string hi=randomKey(random);
+	Tree::size_type nb_between=0;
+	for(Model::const_iterator it=model.lower_bound(lo);it!=model.end() && it->first<hi;++it)
+		nb_between++;
+	CHECK(tree.countRange(lo,hi)==nb_between);
+	#endif // TERNARYTREE_LIGHT
+
+	#ifdef TERNARYTREE_SCORED
+	checkTopK(tree,model,"",5);
+	checkTopK(tree,model,randomKey(random).substr(0,2),3);
+	#endif // TERNARYTREE_SCORED
+}
+
+void addKey(Tree& tree,Model& model,const std::string& key,int stored,std::mt19937& random)
+{
+	switch(random()%3)
+	{
+		case 0:
+			tree.add(key,stored);
+			break;
+		case 1:
+			tree.add(key.begin(),key.end(),stored);
+			break;
+		default:
+			tree.add(key);
+			tree.set(stored);
+			break;
+	}
+	model[key]=stored;
+}
+
+void saveAndLoad(Tree& tree,std::mt19937& random)
+{
+	Tree loaded;
+	#ifdef TERNARYTREE_SCORED
+	loaded.setScoreFunction(score);
+	#endif // TERNARYTREE_SCORED
+
+	const std::string path=file_prefix+".tree";
+	switch(random()%4)
+	{
+		case 0:
+			tree.saveToFile(path,opToString,intToString);
+			loaded.loadFromFile(path,stringToOp,stringToInt);
+			break;
+		case 1:
+			tree.saveToFile(path,opToString,intToString);
+			loaded.loadFromFile(path,stringToOp,stringToInt,nullptr,3);
+			break;
+		case 2:
+		{
+			std::stringstream stream;
+			tree.saveToStream(stream,opToString,intToString);
+			loaded.loadFromStream(stream,stringToOp,stringToInt);
+			break;
+		}
+		default:
+			tree.saveToCompressedFile(path,opToString,intToString);
+			loaded.loadFromCompressedFile(path,stringToOp,stringToInt);
+			break;
+	}
+	std::remove(path.c_str());
+
+	CHECK(loaded.getNbNode()==tree.getNbNode());
+	tree=loaded;
+}
+
+void mergeRandomTree(Tree& tree,Model& model,std::mt19937& random)
+{
+	Tree other;
+	#ifdef TERNARYTREE_SCORED
+	other.setScoreFunction(score);
+	#endif // TERNARYTREE_SCORED
+	Model other_model;
+	for(int i=static_cast<int>(random()%30);i>0;i--)
+	{
+		std::string key=randomKey(random);
+		int stored=static_cast<int>(random()%1000);
+		other.add(key,stored);
+		other_model[key]=stored;
+	}
+
+	switch(random()%4)
+	{
+		case 0:
+			tree.merge(other);
+			for(Model::const_iterator it=other_model.begin();it!=other_model.end();++it)
+				model[it->first]=it->second;
+			CHECK(other.isEmpty());
+			break;
+		case 1:
+			tree.merge(other,Tree::KEEP_CURRENT);
+			model.insert(other_model.begin(),other_model.end());
+			break;
+		case 2:
+		{
+			tree.intersect(other);
+			Model kept;
+			for(Model::const_iterator it=model.begin();it!=model.end();++it)
+				if(other_model.count(it->first)==1)
+					kept.insert(*it);
+			model.swap(kept);
+			break;
+		}
+		default:
+			tree.difference(other);
+			for(Model::const_iterator it=other_model.begin();it!=other_model.end();++it)
+				model.erase(it->first);
+			break;
+	}
+}
+
+void bulkInsert(Tree& tree,Model& model,std::mt19937& random)
+{
+	// some batches only overwrite existing keys
+	std::vector<std::string> existing;
+	if(random()%3==0)
+		for(Model::const_iterator it=model.begin();it!=model.end();++it)
+			existing.push_back(it->first);
+
+	std::vector<std::pair<std::string,int> > pairs;
+	for(int i=static_cast<int>(random()%50);i>0;i--)
+	{
+		std::string key=existing.empty() ? randomKey(random) : existing[random()%existing.size()];
+		pairs.push_back(std::make_pair(key,static_cast<int>(random()%1000)));
+	}
+	if(random()%2==0)
+		std::sort(pairs.begin(),pairs.end());
+
+	Tree::BulkInserter inserter(tree);
+	for(std::size_t i=0;i<pairs.size();i++)
+	{
+		inserter.add(pairs[i].first,pairs[i].second);
+		model[pairs[i].first]=pairs[i].second;
+	}
+	inserter.finish();
+}
+
+void checkStaticTree(const Tree& tree,const Model& model,std::mt19937& random)
+{
+	StaticTernaryTree<char,int> frozen(tree);
+	CHECK(frozen.getNbStored()==model.size());
+	CHECK(frozen.getNbNode()==tree.getNbNode());
+	for(Model::const_iterator it=model.begin();it!=model.end();++it)
+	{
+		const int* stored=frozen.lookup(it->first);
+		CHECK(stored!=nullptr && *stored==it->second);
+	}
+	for(int i=0;i<20;i++)
+	{
+		std::string key=randomKey(random);
+		CHECK((frozen.lookup(key)!=nullptr)==(model.count(key)==1));
+	}
+}
+
+void testTree(std::mt19937& random,unsigned long nb_operations)
+{
+	Tree tree;
+	#ifdef TERNARYTREE_SCORED
+	tree.setScoreFunction(score);
+	#endif // TERNARYTREE_SCORED
+	#ifdef TERNARYTREE_PROFILE
+	// the profiled walks must behave like the other ones
+	tree.setProfileSampling(7);
+	#endif // TERNARYTREE_PROFILE
+	Model model;
+
+	for(unsigned long operation=0;operation<nb_operations;operation++)
+	{
+		std::string key=randomKey(random);
+		unsigned int choice=random()%100;
+
+		if(choice<40)
+			addKey(tree,model,key,static_cast<int>(random()%1000),random);
+		else if(choice<55)
+		{
+			#ifndef TERNARYTREE_LIGHT
+			bool in_model=model.erase(key)==1;
+			bool removed=tree.remove(key);
+			CHECK(removed || !in_model);
+			#endif // TERNARYTREE_LIGHT
+		}
+		else if(choice<80)
+		{
+			Model::const_iterator it=model.find(key);
+			bool found=tree.find(key);
+			CHECK(found || it==model.end());
+			if(it!=model.end())
+				CHECK(tree.hasAStored() && tree.get()==it->second);
+		}
+		else if(choice<83)
+		{
+			#ifndef TERNARYTREE_LIGHT
+			tree.optimize();
+			#endif // TERNARYTREE_LIGHT
+		}
+		else if(choice<86)
+			saveAndLoad(tree,random);
+		else if(choice<89)
+			bulkInsert(tree,model,random);
+		else if(choice<92)
+			mergeRandomTree(tree,model,random);
+		else if(choice<93)
+		{
+			Tree copy(tree);
+			CHECK(copy.getNbNode()==tree.getNbNode());
+			tree.clear();
+			tree=copy;
+		}
+		else if(choice<94)
+			checkStaticTree(tree,model,random);
+
+		if(operation%200==0 || choice>=83)
+			checkTree(tree,model,random);
+	}
+	checkTree(tree,model,random);
+}
+
+void testPersistentTree(std::mt19937& random,unsigned long nb_operations)
+{
+	PersistentTernaryTree<char,int> tree(4);
+	PersistentTernaryTree<char,int>::Reader reader(tree);
+	Model model;
+	Model published;
+
+	for(unsigned long operation=0;operation<nb_operations;operation++)
+	{
+		std::string key=randomKey(random);
+		unsigned int choice=random()%10;
+		if(choice<5)
+		{
+			int stored=static_cast<int>(random()%1000);
+			CHECK(tree.set(key,stored)==(model.count(key)==0));
+			model[key]=stored;
+		}
+		else if(choice<8)
+			CHECK(tree.remove(key)==(model.erase(key)==1));
+		else if(choice<9)
+		{
+			// the pinned version does not see the publication
+			reader.pin();
+			tree.publish();
+			CHECK(reader.getNbStored()==published.size());
+			for(Model::const_iterator it=published.begin();it!=published.end();++it)
+				CHECK(reader.lookup(it->first)!=nullptr && *reader.lookup(it->first)==it->second);
+			published=model;
+			reader.release();
+		}
+		else
+		{
+			reader.pin();
+			CHECK(reader.getNbStored()==published.size());
+			CHECK((reader.lookup(key)!=nullptr)==(published.count(key)==1));
+			reader.release();
+		}
+	}
+}
+
+#ifndef TERNARYTREE_LIGHT
+void testShardedTree(std::mt19937& random,unsigned long nb_operations)
+{
+	ShardedTernaryTree<char,int> tree(4);
+	Model model;
+	for(unsigned long operation=0;operation<nb_operations;operation++)
+	{
+		std::string key=randomKey(random);
+		unsigned int choice=random()%3;
+		if(choice==0)
+		{
+			int stored=static_cast<int>(random()%1000);
+			tree.add(key,stored);
+			model[key]=stored;
+		}
+		else if(choice==1)
+		{
+			model.erase(key);
+			tree.remove(key);
+		}
+		else
+		{
+			int stored=0;
+			Model::const_iterator it=model.find(key);
+			CHECK(tree.find(key,stored)==(it!=model.end()));
+			if(it!=model.end())
+				CHECK(stored==it->second);
+		}
+	}
+
+	Model::const_iterator expected=model.begin();
+	tree.forEach([&](const std::vector<char>& key,const int& stored)
+	{
+		CHECK(expected!=model.end());
+		CHECK(std::string(key.begin(),key.end())==expected->first && stored==expected->second);
+		++expected;
+	});
+	CHECK(expected==model.end());
+	CHECK(tree.getNbStored()==model.size());
+}
+#endif // TERNARYTREE_LIGHT
+
+} // namespace
+
+int main(int argc,char** argv)
+{
+	unsigned long seed=argc>1 ? std::stoul(argv[1]) : 1;
+	unsigned long nb_operations=argc>2 ? std::stoul(argv[2]) : 20000;
+	file_prefix=argv[0];
+
+	std::mt19937 random(static_cast<std::mt19937::result_type>(seed));
+	testTree(random,nb_operations);
+	testPersistentTree(random,nb_operations);
+	#ifndef TERNARYTREE_LIGHT
+	testShardedTree(random,nb_operations/4);
+	#endif // TERNARYTREE_LIGHT
+
+	std::cout<<"seed "<<seed<<" : "<<nb_operations<<" operations checked"<<std::endl;
+	return 0;
+}
@@ -0,0 +1,273 @@
+// Copyright (C) 2020 Quentin Putaud
+// Distributed under the GNU General Public License version 3
+// (http://www.gnu.org/licenses)
+
+// Fuzz target. The first byte of the input chooses what the rest is used for :
+// 0 : operations applied to a TernaryTree and to an std::map,
+// 1 : the content of a compressed file,
+// 2 : the content of a frame, written with a valid checksum so that the decoding of the nodes is reached,
+// 3 : data given to the codec.
+// Built with TERNARYTREE_LIBFUZZER, it is a libFuzzer target. Otherwise a main replays the files given
+// as arguments, or random inputs : fuzz [seed] [number of inputs] or fuzz file...
+
+#include "ternarytree.hpp"
+#include "check.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+
+typedef TernaryTree<char,int> Tree;
+
+namespace
+{
+
+// a name per process, so that several fuzzing jobs can share a directory
+const std::string& filePath()
+{
+	static const std::string path="ternarytree_fuzz_"+std::to_string(std::random_device()())+".ttz";
+	return path;
+}
+
+// the loaded strings come from the input, these conversions accept any of them
+char anyStringToOp(std::string str)
+{
+	return str.empty() ? '\0' : str[0];
+}
+
+int anyStringToInt(std::string str)
+{
+	unsigned int stored=0;
+	for(std::size_t i=0;i<str.size() && i<8;i++)
+		stored=stored*31+static_cast<unsigned char>(str[i]);
+	return static_cast<int>(stored&0x7fffffff);
+}
+
+void fuzzOperations(const std::uint8_t* data,std::size_t size)
+{
+	Tree tree;
+	std::map<std::string,int> model;
+	std::size_t i=0;
+	int stored=0;
+	while(i+1<size)
+	{
+		unsigned int operation=data[i]%4;
+		std::size_t length=1+data[i+1]%5;
+		i+=2;
+		std::string key;
+		for(;i<size && key.size()<length;i++)
+			key+=static_cast<char>('a'+data[i]%4);
+		if(key.empty())
+			break;
+
+		#ifdef TERNARYTREE_LIGHT
+		// no remove nor optimize in the light tree
+		operation%=2;
+		#endif // TERNARYTREE_LIGHT
+		switch(operation)
+		{
+			case 0:
+				tree.add(key,stored);
+				model[key]=stored++;
+				break;
+			case 1:
+			{
+				std::map<std::string,int>::const_iterator it=model.find(key);
+				const int* found=tree.lookup(key);
+				CHECK((found==nullptr)==(it==model.end()));
+				CHECK(found==nullptr || *found==it->second);
+				break;
+			}
+			#ifndef TERNARYTREE_LIGHT
+			case 2:
+			{
+				bool removed=tree.remove(key);
+				CHECK(!model.count(key) || removed);
+				model.erase(key);
+				break;
+			}
+			default:
+				tree.optimize();
+				break;
+			#endif // TERNARYTREE_LIGHT
+		}
+	}
+
+	CHECK(tree.checkIntegrity());
+	CHECK(tree.getNbStored()==model.size());
+	for(std::map<std::string,int>::const_iterator it=model.begin();it!=model.end();++it)
+		CHECK(tree.lookup(it->first)!=nullptr && *tree.lookup(it->first)==it->second);
+}
+
+void loadFile(const std::string& content,bool check_tree)
+{
+	{
+		std::ofstream output(filePath().c_str(),std::ios::binary);
+		output<<content;
+	}
+	Tree tree;
+	try
+	{
+		tree.loadFromCompressedFile(filePath(),anyStringToOp,anyStringToInt);
+	}
+	catch(const std::runtime_error&)
+	{
+		CHECK(tree.isEmpty());
+	}
+	// a checksum can not protect the order of the nodes of a frame written on purpose
+	if(check_tree)
+		CHECK(tree.checkIntegrity());
+	std::remove(filePath().c_str());
+}
+
+void fuzzFrame(const std::uint8_t* data,std::size_t size)
+{
+	if(size<3)
+		return;
+	std::size_t nb_node=data[0]+1;
+	std::size_t structure_size=(nb_node+1)/2;
+	std::size_t ops_size=data[1];
+	data+=2;
+	size-=2;
+	if(structure_size>size)
+		return;
+	std::string structure(reinterpret_cast<const char*>(data),structure_size);
+	std::string rest(reinterpret_cast<const char*>(data)+structure_size,size-structure_size);
+	if(ops_size>rest.size())
+		ops_size=rest.size();
+	std::string ops=rest.substr(0,ops_size);
+	std::string stored=rest.substr(ops_size);
+
+	std::string nb_node_bytes;
+	TernaryTreeCodec::writeVarint(nb_node_bytes,nb_node);
+	std::uint32_t crc=TernaryTreeCodec::crc32(nb_node_bytes);
+	crc=TernaryTreeCodec::crc32(structure,crc);
+	crc=TernaryTreeCodec::crc32(ops,crc);
+	crc=TernaryTreeCodec::crc32(stored,crc);
+
+	std::ostringstream output;
+	output.write("TTZ\2",4);
+	output<<nb_node_bytes;
+	TernaryTreeCodec::writeBlock(output,structure);
+	TernaryTreeCodec::writeBlock(output,ops);
+	TernaryTreeCodec::writeBlock(output,stored);
+	for(int i=0;i<4;i++)
+		output.put(static_cast<char>((crc>>(8*i))&255));
+	output.put('\0');
+	loadFile(output.str(),false);
+}
+
+void fuzzCodec(const std::uint8_t* data,std::size_t size)
+{
+	std::string input(reinterpret_cast<const char*>(data),size);
+
+	std::string compressed;
+	std::string decompressed;
+	TernaryTreeCodec::compress(input,compressed);
+	CHECK(TernaryTreeCodec::decompress(compressed,input.size(),decompressed));
+	CHECK(decompressed==input);
+
+	std::istringstream stream(input);
+	std::string raw;
+	TernaryTreeCodec::readBlock(stream,raw);
+	if(size>0)
+		TernaryTreeCodec::decompress(input.substr(1),data[0]*64,raw);
+}
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data,std::size_t size)
+{
+	if(size==0)
+		return 0;
+	switch(data[0]%4)
+	{
+		case 0:
+			fuzzOperations(data+1,size-1);
+			break;
+		case 1:
+			loadFile("TTZ\2"+std::string(reinterpret_cast<const char*>(data)+1,size-1),true);
+			break;
+		case 2:
+			fuzzFrame(data+1,size-1);
+			break;
+		default:
+			fuzzCodec(data+1,size-1);
+			break;
+	}
+	return 0;
+}
+
+#ifndef TERNARYTREE_LIBFUZZER
+namespace
+{
+
+// a valid compressed file, whose mutations reach deeper than random bytes
+std::string validFile(std::mt19937& random)
+{
+	Tree tree;
+	for(int i=random()%200;i>0;i--)
+	{
+		std::string key;
+		for(int j=1+static_cast<int>(random()%6);j>0;j--)
+			key+=static_cast<char>('a'+random()%6);
+		tree.add(key,static_cast<int>(random()%1000));
+	}
+	tree.saveToCompressedFile(filePath(),opToString,intToString);
+	std::ifstream input(filePath().c_str(),std::ios::binary);
+	std::string content((std::istreambuf_iterator<char>(input)),std::istreambuf_iterator<char>());
+	input.close();
+	std::remove(filePath().c_str());
+	return content;
+}
+
+} // namespace
+
+int main(int argc,char** argv)
+{
+	std::string first=argc>1 ? argv[1] : "";
+	if(!first.empty() && first.find_first_not_of("0123456789")!=std::string::npos)
+	{
+		for(int i=1;i<argc;i++)
+		{
+			std::ifstream input(argv[i],std::ios::binary);
+			CHECK(input);
+			std::string content((std::istreambuf_iterator<char>(input)),std::istreambuf_iterator<char>());
+			LLVMFuzzerTestOneInput(reinterpret_cast<const std::uint8_t*>(content.data()),content.size());
+		}
+		std::cout<<argc-1<<" inputs replayed"<<std::endl;
+		return 0;
+	}
+
+	unsigned long seed=argc>1 ? std::stoul(argv[1]) : 1;
+	unsigned long nb_inputs=argc>2 ? std::stoul(argv[2]) : 2000;
+	std::mt19937 random(static_cast<std::mt19937::result_type>(seed));
+	for(unsigned long n=0;n<nb_inputs;n++)
+	{
+		std::string input(1,static_cast<char>(n%4));
+		if(n%4==1)
+		{
+			// a valid file without its magic, with a few bytes changed or cut
+			std::string file=validFile(random).substr(4);
+			for(int i=random()%4;i>0 && !file.empty();i--)
+				file[random()%file.size()]=static_cast<char>(random());
+			if(!file.empty() && random()%4==0)
+				file.resize(random()%file.size());
+			input+=file;
+		}
+		else
+		{
+			for(int i=random()%300;i>0;i--)
+				input+=static_cast<char>(random());
+		}
+		LLVMFuzzerTestOneInput(reinterpret_cast<const std::uint8_t*>(input.data()),input.size());
+	}
+	std::cout<<"seed "<<seed<<" : "<<nb_inputs<<" inputs checked"<<std::endl;
+	return 0;
+}
+#endif // TERNARYTREE_LIBFUZZER
@@ -0,0 +1,209 @@
+// Copyright (C) 2020 Quentin Putaud
+// Distributed under the GNU General Public License version 3
+// (http://www.gnu.org/licenses)
+
+// Checks of bugs found in review, built once per configuration like the differential test.
+
+#include "ternarytree.hpp"
+#include "check.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+std::string file_prefix;
+
+// a (key,value) call must never be taken for a range of OP
+void testKeyValueCalls()
+{
+	TernaryTree<char,std::string> tree;
+	tree.add(std::string("key"),"value");
+	CHECK(tree.lookup(std::string("key"))!=nullptr && *tree.lookup(std::string("key"))=="value");
+
+	std::string key("other");
+	tree.add(key.begin(),key.end(),"value");
+	CHECK(tree.lookup(key)!=nullptr && *tree.lookup(key)=="value");
+	CHECK(tree.getNbStored()==2);
+
+	// pointers on a buffer are still a range of OP
+	const char* buffer="keys";
+	CHECK(tree.find(buffer,buffer+3));
+	CHECK(!tree.find(buffer,buffer+4));
+}
+
+#ifdef TERNARYTREE_SCORED
+double identity(const int& stored)
+{
+	return stored;
+}
+
+// a BulkInserter overwriting a value must update the greatest scores
+void testBulkInserterOverwrite()
+{
+	TernaryTree<char,int> tree;
+	tree.setScoreFunction(identity);
+	tree.add(std::string("ab"),100);
+	tree.add(std::string("c"),500);
+	{
+		TernaryTree<char,int>::BulkInserter inserter(tree);
+		inserter.add(std::string("ab"),1000);
+	}
+	CHECK(tree.checkIntegrity());
+
+	std::string best;
+	std::string prefix;
+	tree.topK(prefix.begin(),prefix.end(),1,[&](const std::vector<char>& key,const int&)
+	{
+		best.assign(key.begin(),key.end());
+	});
+	CHECK(best=="ab");
+}
+#endif // TERNARYTREE_SCORED
+
+// a corrupted compressed file is refused, or gives back exactly the saved tree
+void testCompressedCorruption()
+{
+	std::mt19937 random(7);
+	TernaryTree<char,int> tree;
+	for(int i=0;i<20000;i++)
+	{
+		std::string key;
+		for(int j=1+static_cast<int>(random()%8);j>0;j--)
+			key+=static_cast<char>('a'+random()%16);
+		tree.add(key,static_cast<int>(random()%100000));
+	}
+
+	const std::string path=file_prefix+".ttz";
+	tree.saveToCompressedFile(path,opToString,intToString);
+	std::ifstream input(path.c_str(),std::ios::binary);
+	const std::string file((std::istreambuf_iterator<char>(input)),std::istreambuf_iterator<char>());
+	input.close();
+	CHECK(file.size()>4);
+
+	for(int i=0;i<200;i++)
+	{
+		std::string corrupted=file;
+		std::size_t pos=4+random()%(corrupted.size()-4);
+		switch(i%3)
+		{
+			case 0:
+				corrupted[pos]=static_cast<char>(corrupted[pos]^(1<<(random()%8)));
+				break;
+			case 1:
+				for(int j=0;j<8;j++)
+					corrupted[4+random()%(corrupted.size()-4)]=static_cast<char>(random());
+				break;
+			default:
+				corrupted.resize(pos);
+				break;
+		}
+		{
+			std::ofstream output(path.c_str(),std::ios::binary);
+			output<<corrupted;
+		}
+
+		TernaryTree<char,int> loaded;
+		try
+		{
+			loaded.loadFromCompressedFile(path,stringToOp,stringToInt);
+		}
+		catch(const std::runtime_error&)
+		{
+			CHECK(loaded.isEmpty());
+			continue;
+		}
+		// the corruption did not change the content of the frames
+		CHECK(loaded.checkIntegrity());
+		CHECK(loaded.getNbNode()==tree.getNbNode() && loaded.getNbStored()==tree.getNbStored());
+	}
+	std::remove(path.c_str());
+
+	// a block announcing more data than the stream has is refused before any allocation
+	std::string header;
+	TernaryTreeCodec::writeVarint(header,std::uint64_t(1)<<31);
+	header+='\1';
+	TernaryTreeCodec::writeVarint(header,std::uint64_t(1)<<31);
+	std::istringstream stream(header);
+	std::string raw;
+	CHECK(!TernaryTreeCodec::readBlock(stream,raw));
+
+	CHECK(TernaryTreeCodec::crc32("123456789")==0xCBF43926u);
+}
+
+std::mutex threads_mutex;
+std::set<std::thread::id> threads;
+
+char recordingStringToOp(std::string str)
+{
+	std::lock_guard<std::mutex> lock(threads_mutex);
+	threads.insert(std::this_thread::get_id());
+	return stringToOp(str);
+}
+
+// loadFromFile only uses other threads when it is asked to
+void testLoadThreads()
+{
+	TernaryTree<char,int> tree;
+	for(char c='a';c<='z';c++)
+		for(char d='a';d<='z';d++)
+			tree.add(std::string(1,c)+d,c*d);
+
+	const std::string path=file_prefix+".tree";
+	tree.saveToFile(path,opToString,intToString);
+
+	TernaryTree<char,int> loaded;
+	loaded.loadFromFile(path,recordingStringToOp,stringToInt);
+	CHECK(loaded.getNbStored()==tree.getNbStored());
+	CHECK(threads.size()==1 && *threads.begin()==std::this_thread::get_id());
+
+	loaded.loadFromFile(path,recordingStringToOp,stringToInt,nullptr,4);
+	CHECK(loaded.getNbStored()==tree.getNbStored());
+	std::remove(path.c_str());
+}
+
+#ifdef TERNARYTREE_PROFILE
+// find, and so get, is sampled like lookup
+void testProfiledFind()
+{
+	TernaryTree<char,int> tree;
+	tree.add(std::string("abc"),1);
+	tree.setProfileSampling(1);
+	tree.resetProfile();
+	CHECK(tree.find(std::string("abc")) && tree.get()==1);
+	CHECK(!tree.find(std::string("abd")));
+
+	std::ostringstream json;
+	tree.saveProfileToJson(json);
+	CHECK(json.str().find("\"sampled_lookups\":2")!=std::string::npos);
+}
+#endif // TERNARYTREE_PROFILE
+
+} // namespace
+
+int main(int,char** argv)
+{
+	file_prefix=argv[0];
+
+	testKeyValueCalls();
+	#ifdef TERNARYTREE_SCORED
+	testBulkInserterOverwrite();
+	#endif // TERNARYTREE_SCORED
+	testCompressedCorruption();
+	testLoadThreads();
+	#ifdef TERNARYTREE_PROFILE
+	testProfiledFind();
+	#endif // TERNARYTREE_PROFILE
+
+	std::cout<<"regression checks passed"<<std::endl;
+	return 0;
+}